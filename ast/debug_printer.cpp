@@ -136,7 +136,12 @@ void print_val_expr(const ValExpr& v) {
                 if (i > 0) std::cout << ", ";
                 print_val_expr(*a.args[i]);
             }
-            std::cout << "]}";
+            std::cout << "]";
+            if (a.bulk_size != nullptr) {
+                std::cout << ", bulk_size=";
+                print_val_expr(*a.bulk_size);
+            }
+            std::cout << "}";
         },
 
         // Unalias 
@@ -217,7 +222,16 @@ void print_stmt(const Stmt& s) {
                 if (i > 0) std::cout << ", ";
                 print_val_expr(*b.args[i]);
             }
-            std::cout << "]}\n";
+            std::cout << "]";
+            if (b.delay_ms) {
+                std::cout << ", delay_ms=";
+                print_val_expr(*b.delay_ms);
+            }
+            if (b.broadcast_count) {
+                std::cout << ", broadcast_count=";
+                print_val_expr(*b.broadcast_count);
+            }
+            std::cout << "}\n";
         },
 
         [&](const Stmt::Print& p) {
@@ -40,11 +40,22 @@ struct ValExpr {
         Cap cap;
         std::shared_ptr<ValExpr> init_expr;
         std::shared_ptr<ValExpr> size;
+        // Set by escape analysis when the memory can not outlive the running behaviour, in which
+        // case it is taken from the behaviour's arena
+        bool arena_allocated = false;
+        // Also set by escape analysis, to the number of elements, when additionally the size is a
+        // constant and the expression runs at most once per call (it is not inside a loop). The
+        // array can then live in the stack frame of the callable.
+        std::optional<int> constant_frame_size;
     };
     struct ActorConstruction {
         std::string actor_name;
         std::string constructor_name;
         std::vector<std::shared_ptr<ValExpr>> args; 
+        // Set for [new cap[size] Actor.constructor(args)], which creates [size] actors at once (each
+        // constructed with [args]) and evaluates to an array of them. nullptr for a single actor
+        std::shared_ptr<ValExpr> bulk_size = nullptr;
+        Cap bulk_cap = Cap{Cap::Ref{}};
     };
 
     // Unalias
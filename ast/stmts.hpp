@@ -16,6 +16,11 @@ struct Stmt {
         std::shared_ptr<ValExpr> actor;
         std::string behaviour_name;
         std::vector<std::shared_ptr<ValExpr>> args; 
+        // Set for [actor->be(args) after N ms]. nullptr for sends that are delivered immediately
+        std::shared_ptr<ValExpr> delay_ms = nullptr;
+        // Set for [broadcast(actors, n)->be(args)]: [actor] is then a val array of actors, and the 
+        // message goes to its first n elements. nullptr for sends to a single actor
+        std::shared_ptr<ValExpr> broadcast_count = nullptr;
     };
     struct Print {
         std::shared_ptr<ValExpr> print_expr;
@@ -17,6 +17,8 @@ struct TopLevelItem {
         std::vector<VarDecl> params;
         std::vector<std::shared_ptr<Stmt>> body;
         std::shared_ptr<std::unordered_set<std::string>> locks_dereferenced;
+        // Whether the callable may call itself, directly or through other callables
+        bool recursive = true;
     };
     struct Behaviour {
         std::string name;
@@ -28,10 +30,14 @@ struct TopLevelItem {
         std::vector<VarDecl> params;
         std::vector<std::shared_ptr<Stmt>> body;
         std::shared_ptr<std::unordered_set<std::string>> locks_dereferenced;
+        // Whether the callable may call itself, directly or through other callables
+        bool recursive = true;
     };
     struct Actor {
         std::string name;
         std::unordered_map<std::string, std::shared_ptr<const Type>> member_vars;
+        // Names of [member_vars] in the order they are declared
+        std::vector<std::string> member_var_order;
         std::vector<std::variant<
             std::shared_ptr<Func>,
             std::shared_ptr<Constructor>,
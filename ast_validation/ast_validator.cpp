@@ -2,6 +2,7 @@
 #include "full_type_checker.hpp"
 #include "declaration_collector.hpp"
 #include "compute_lock_info.hpp"
+#include "escape_analysis.hpp"
 #include "debug_printer.cpp"
 
 bool validate_program(Program* root) {
@@ -20,6 +21,7 @@ bool validate_program(Program* root) {
         return false;
     }
     compute_lock_info(root, decl_collection);
+    compute_escape_info(root);
     return true;
 }
 
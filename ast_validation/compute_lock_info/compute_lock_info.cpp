@@ -9,7 +9,7 @@
 void compute_lock_info(Program* root, std::shared_ptr<DeclCollection> decl_collection) {
     // 1. Create the graph
     std::shared_ptr<CallableGraph> callable_graph = build_graph(root, decl_collection);
-    // 2. Fill out the connected components
+    // 2. Fill out the connected components, which also tells which callables are recursive
     find_sccs(callable_graph);
     // 3. Fill the function lock info
     fill_all_callable_lock_info(callable_graph, decl_collection);
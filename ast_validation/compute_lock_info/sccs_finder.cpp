@@ -41,10 +41,12 @@ void find_sccs(std::shared_ptr<CallableGraph> graph) {
     // Second iteration
     std::shared_ptr<std::unordered_set<std::string>> callable_locks = 
         std::make_shared<std::unordered_set<std::string>>(); 
+    std::vector<SyncCallable> component;
     std::function<void(SyncCallable)> label_components;
     label_components = [&](SyncCallable sync_callable) {
         assert(get_callable_locks(sync_callable) == nullptr);
         set_callable_locks(sync_callable, callable_locks);
+        component.push_back(sync_callable);
         for(SyncCallable neighbour: rev_graph[sync_callable]) {
 
             if(get_callable_locks(neighbour) == nullptr) {
@@ -55,6 +57,12 @@ void find_sccs(std::shared_ptr<CallableGraph> graph) {
     for(auto& sync_callable: std::views::reverse(visit_order)) {
         if(get_callable_locks(sync_callable) == nullptr) {
             label_components(sync_callable);
+            // A callable alone in its component is only recursive if it calls itself
+            bool recursive = component.size() > 1 || (*graph)[sync_callable].contains(sync_callable);
+            for(SyncCallable member: component) {
+                set_callable_recursive(member, recursive);
+            }
+            component.clear();
             callable_locks = std::make_shared<std::unordered_set<std::string>>();
         }
     }
@@ -20,6 +20,13 @@ void set_callable_locks(
         }, sync_callable.callable);
 }
 
+void set_callable_recursive(SyncCallable sync_callable, bool recursive) {
+    std::visit(
+        [&](const auto& callable) {
+            callable->recursive = recursive;
+        }, sync_callable.callable);
+}
+
 void add_valexpr_lock_info(std::shared_ptr<ValExpr> val_expr, LockInfoEnv& env) {
     auto curried = [&](std::shared_ptr<ValExpr> val_expr) {
         add_valexpr_lock_info(val_expr, env);
@@ -7,4 +7,6 @@ void set_callable_locks(
     SyncCallable sync_callable,
     std::shared_ptr<std::unordered_set<std::string>> locks_dereferenced);
 
+void set_callable_recursive(SyncCallable sync_callable, bool recursive);
+
 void add_valexpr_lock_info(std::shared_ptr<ValExpr> val_expr, LockInfoEnv& env);
\ No newline at end of file
@@ -0,0 +1,282 @@
+#include "escape_analysis.hpp"
+#include "pattern_matching_boilerplate.hpp"
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+
+/*
+A flow-insensitive analysis, run separately on every callable. Its nodes are the allocation sites
+([NewInstance] expressions) and the local variables of the callable (names are unique after alpha
+renaming). Whenever the value of an expression may be stored into a local variable, there is an
+edge from the nodes the value may come from to that variable. A value escapes when it may be
+stored anywhere else: an actor member, a message, the heap (which covers locked data), the
+arguments of a callable, or a return value. Escaping is then propagated backwards along the
+edges, and the sites that did not escape are allocated from the behaviour's arena.
+A site that did not escape, has a constant size and is not inside a loop creates at most one array
+per call, which can therefore live in the callable's stack frame instead.
+*/
+
+using FlowNodes = std::unordered_set<std::string>;
+
+struct EscapeEnv {
+    std::unordered_set<std::string> locals;
+    // Allocation sites, named [new.<n>] so they can not clash with variable names
+    std::unordered_map<std::string, ValExpr::NewInstance*> sites;
+    // [flows_into[v]] are the nodes whose value may be stored into the variable [v]
+    std::unordered_map<std::string, FlowNodes> flows_into;
+    FlowNodes escaped;
+    // Number of loops around the expression being analysed
+    int loop_depth = 0;
+};
+
+// The value of [val_expr] if it is an integer known at compile time
+static std::optional<int> constant_int_value(std::shared_ptr<ValExpr> val_expr) {
+    return std::visit(Overload{
+        [&](const ValExpr::VInt& v_int) -> std::optional<int> {
+            return v_int.v;
+        },
+        [&](const ValExpr::BinOpExpr& bin_op_expr) -> std::optional<int> {
+            std::optional<int> lhs = constant_int_value(bin_op_expr.lhs);
+            std::optional<int> rhs = constant_int_value(bin_op_expr.rhs);
+            if(!lhs || !rhs) {
+                return std::nullopt;
+            }
+            // Only the operations that can not trap. They wrap around on overflow, like the i32
+            // arithmetic of the generated code, so the result is the size the array gets.
+            uint32_t lhs_bits = static_cast<uint32_t>(*lhs);
+            uint32_t rhs_bits = static_cast<uint32_t>(*rhs);
+            switch(bin_op_expr.op) {
+                case BinOp::Add: return static_cast<int>(lhs_bits + rhs_bits);
+                case BinOp::Sub: return static_cast<int>(lhs_bits - rhs_bits);
+                case BinOp::Mul: return static_cast<int>(lhs_bits * rhs_bits);
+                default: return std::nullopt;
+            }
+        },
+        [&](const auto&) -> std::optional<int> {
+            return std::nullopt;
+        }
+    }, val_expr->t);
+}
+
+static void escape(const FlowNodes& nodes, EscapeEnv& env) {
+    env.escaped.insert(nodes.begin(), nodes.end());
+}
+
+// The local variable whose storage [lhs] refers to, if it does not go through a pointer
+static std::optional<std::string> local_root(std::shared_ptr<ValExpr> lhs, EscapeEnv& env) {
+    return std::visit(Overload{
+        [&](const ValExpr::VVar& var) -> std::optional<std::string> {
+            if(env.locals.contains(var.name)) {
+                return var.name;
+            }
+            return std::nullopt;
+        },
+        [&](const ValExpr::Field& field) {
+            return local_root(field.base, env);
+        },
+        [&](const auto&) -> std::optional<std::string> {
+            return std::nullopt;
+        }
+    }, lhs->t);
+}
+
+// Records the flows inside [val_expr] and returns the nodes its value may come from
+static FlowNodes analyse_valexpr(std::shared_ptr<ValExpr> val_expr, EscapeEnv& env) {
+    return std::visit(Overload{
+        [&](const ValExpr::VVar& var) -> FlowNodes {
+            if(env.locals.contains(var.name)) {
+                return {var.name};
+            }
+            return {};
+        },
+        [&](const ValExpr::VStruct& vstruct) {
+            FlowNodes sources;
+            for(auto& [field_name, field_expr]: vstruct.fields) {
+                FlowNodes field_sources = analyse_valexpr(field_expr, env);
+                sources.insert(field_sources.begin(), field_sources.end());
+            }
+            return sources;
+        },
+        [&](ValExpr::NewInstance& new_instance) -> FlowNodes {
+            std::string site = "new." + std::to_string(env.sites.size());
+            env.sites.emplace(site, &new_instance);
+            new_instance.constant_frame_size = std::nullopt;
+            if(env.loop_depth == 0) {
+                std::optional<int> size = constant_int_value(new_instance.size);
+                if(size && *size > 0) {
+                    new_instance.constant_frame_size = size;
+                }
+            }
+            // The default value is stored into the new (heap) memory
+            escape(analyse_valexpr(new_instance.init_expr, env), env);
+            analyse_valexpr(new_instance.size, env);
+            if(std::holds_alternative<Cap::Locked>(new_instance.cap.t)) {
+                // Locked data is shared with every actor that knows the lock
+                env.escaped.insert(site);
+            }
+            return {site};
+        },
+        [&](const ValExpr::ActorConstruction& actor_construction) -> FlowNodes {
+            for(auto arg: actor_construction.args) {
+                escape(analyse_valexpr(arg, env), env);
+            }
+            if(actor_construction.bulk_size != nullptr) {
+                analyse_valexpr(actor_construction.bulk_size, env);
+            }
+            return {};
+        },
+        [&](const ValExpr::Unalias& unalias) -> FlowNodes {
+            if(env.locals.contains(unalias.var_name)) {
+                return {unalias.var_name};
+            }
+            return {};
+        },
+        [&](const ValExpr::PointerAccess& pointer_access) -> FlowNodes {
+            // The element is loaded from the heap, where only escaped values are stored
+            analyse_valexpr(pointer_access.value, env);
+            analyse_valexpr(pointer_access.index, env);
+            return {};
+        },
+        [&](const ValExpr::Field& field) {
+            return analyse_valexpr(field.base, env);
+        },
+        [&](const ValExpr::Assignment& assignment) {
+            // The result is the previous value of [lhs]
+            FlowNodes prev_sources = analyse_valexpr(assignment.lhs, env);
+            FlowNodes rhs_sources = analyse_valexpr(assignment.rhs, env);
+            std::optional<std::string> root = local_root(assignment.lhs, env);
+            if(root) {
+                env.flows_into[*root].insert(rhs_sources.begin(), rhs_sources.end());
+            }
+            else {
+                escape(rhs_sources, env);
+            }
+            return prev_sources;
+        },
+        [&](const ValExpr::FuncCall& func_call) -> FlowNodes {
+            // Returned values escaped in the callee
+            for(auto arg: func_call.args) {
+                escape(analyse_valexpr(arg, env), env);
+            }
+            return {};
+        },
+        [&](const ValExpr::BinOpExpr& bin_op_expr) -> FlowNodes {
+            analyse_valexpr(bin_op_expr.lhs, env);
+            analyse_valexpr(bin_op_expr.rhs, env);
+            return {};
+        },
+        [&](const auto&) -> FlowNodes {
+            return {};
+        }
+    }, val_expr->t);
+}
+
+static void analyse_stmt_list(std::vector<std::shared_ptr<Stmt>>& stmt_list, EscapeEnv& env);
+
+static void analyse_stmt(std::shared_ptr<Stmt> stmt, EscapeEnv& env) {
+    std::visit(Overload{
+        [&](const Stmt::VarDeclWithInit& var_decl_with_init) {
+            env.locals.insert(var_decl_with_init.name);
+            FlowNodes init_sources = analyse_valexpr(var_decl_with_init.init, env);
+            env.flows_into[var_decl_with_init.name].insert(init_sources.begin(), init_sources.end());
+        },
+        [&](const Stmt::MemberInitialize& member_init) {
+            escape(analyse_valexpr(member_init.init, env), env);
+        },
+        [&](const Stmt::BehaviourCall& be_call) {
+            analyse_valexpr(be_call.actor, env);
+            for(auto arg: be_call.args) {
+                escape(analyse_valexpr(arg, env), env);
+            }
+            if(be_call.delay_ms != nullptr) {
+                analyse_valexpr(be_call.delay_ms, env);
+            }
+            if(be_call.broadcast_count != nullptr) {
+                analyse_valexpr(be_call.broadcast_count, env);
+            }
+        },
+        [&](const Stmt::Print& print_stmt) {
+            analyse_valexpr(print_stmt.print_expr, env);
+        },
+        [&](const Stmt::Expr& expr) {
+            analyse_valexpr(expr.expr, env);
+        },
+        [&](Stmt::If& if_stmt) {
+            analyse_valexpr(if_stmt.cond, env);
+            analyse_stmt_list(if_stmt.then_body, env);
+            if(if_stmt.else_body) {
+                analyse_stmt_list(*if_stmt.else_body, env);
+            }
+        },
+        [&](Stmt::While& while_stmt) {
+            env.loop_depth++;
+            analyse_valexpr(while_stmt.cond, env);
+            analyse_stmt_list(while_stmt.body, env);
+            env.loop_depth--;
+        },
+        [&](std::shared_ptr<Stmt::Atomic> atomic_stmt) {
+            analyse_stmt_list(atomic_stmt->body, env);
+        },
+        [&](const Stmt::Return& return_stmt) {
+            escape(analyse_valexpr(return_stmt.expr, env), env);
+        }
+    }, stmt->t);
+}
+
+static void analyse_stmt_list(std::vector<std::shared_ptr<Stmt>>& stmt_list, EscapeEnv& env) {
+    for(std::shared_ptr<Stmt> stmt: stmt_list) {
+        analyse_stmt(stmt, env);
+    }
+}
+
+static void analyse_callable(
+    std::vector<TopLevelItem::VarDecl>& params,
+    std::vector<std::shared_ptr<Stmt>>& body) {
+    EscapeEnv env;
+    for(TopLevelItem::VarDecl& param: params) {
+        env.locals.insert(param.name);
+    }
+    // Variables are declared before use, so their names are known by the time they are read
+    analyse_stmt_list(body, env);
+
+    // Everything that may be stored into an escaping variable escapes as well
+    std::vector<std::string> worklist(env.escaped.begin(), env.escaped.end());
+    while(!worklist.empty()) {
+        std::string node = worklist.back();
+        worklist.pop_back();
+        auto it = env.flows_into.find(node);
+        if(it == env.flows_into.end()) {
+            continue;
+        }
+        for(const std::string& source: it->second) {
+            if(env.escaped.insert(source).second) {
+                worklist.push_back(source);
+            }
+        }
+    }
+    for(auto& [site, new_instance]: env.sites) {
+        new_instance->arena_allocated = !env.escaped.contains(site);
+        if(!new_instance->arena_allocated) {
+            new_instance->constant_frame_size = std::nullopt;
+        }
+    }
+}
+
+void compute_escape_info(Program* root) {
+    for(TopLevelItem& toplevel_item: root->top_level_items) {
+        std::visit(Overload{
+            [&](const TopLevelItem::TypeDef&){},
+            [&](std::shared_ptr<TopLevelItem::Func> func_def) {
+                analyse_callable(func_def->params, func_def->body);
+            },
+            [&](std::shared_ptr<TopLevelItem::Actor> actor_def) {
+                for(auto actor_mem: actor_def->actor_members) {
+                    std::visit(
+                        [&](const auto& mem) {
+                            analyse_callable(mem->params, mem->body);
+                        }, actor_mem);
+                }
+            }
+        }, toplevel_item.t);
+    }
+}
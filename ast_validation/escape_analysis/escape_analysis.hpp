@@ -0,0 +1,6 @@
+#pragma once
+#include "top_level.hpp"
+
+// Marks the [NewInstance] expressions whose result never outlives the behaviour that allocated
+// it (see [ValExpr::NewInstance::arena_allocated])
+void compute_escape_info(Program* root);
@@ -239,7 +239,33 @@ std::shared_ptr<const Type> val_expr_type(CoreEnv& env, std::shared_ptr<ValExpr>
                 std::cerr << "Parameters passed into the constructor are not valid" << std::endl;
                 return nullptr;
             }
-            return std::make_shared<Type>(Type{Type::TActor{actor_constr_expr.actor_name}, std::nullopt});
+            auto actor_type = std::make_shared<Type>(Type{Type::TActor{actor_constr_expr.actor_name}, std::nullopt});
+            if(actor_constr_expr.bulk_size == nullptr) {
+                return actor_type;
+            }
+            // Every actor gets the same arguments, which an iso argument can not be shared as
+            for(const TopLevelItem::VarDecl& param: constructor->params) {
+                const Type::Pointer* pointer_type = std::get_if<Type::Pointer>(&param.type->t);
+                if(pointer_type && std::holds_alternative<Cap::Iso>(pointer_type->cap.t)) {
+                    report_error_location(val_expr->source_span);
+                    std::cerr << "Constructor " << actor_constr_expr.constructor_name 
+                        << " takes iso parameters, so it can not create actors in bulk" << std::endl;
+                    return nullptr;
+                }
+            }
+            auto size_type = val_expr_type(env, actor_constr_expr.bulk_size);
+            if(!size_type) {
+                return nullptr;
+            }
+            auto int_type = std::make_shared<Type>(Type{Type::TInt{}, std::nullopt});
+            if(!type_assignable(env.type_env.type_context, int_type, size_type)) {
+                report_error_location(val_expr->source_span);
+                std::cerr << "Size expression must be of type int" << std::endl;
+                return nullptr;
+            }
+            // Same as [NewInstance]: the array is fresh, so it can be unaliased
+            return std::make_shared<Type>(
+                    Type{Type::Pointer{actor_type, actor_constr_expr.bulk_cap}, Cap{Cap::Iso_cap{}}});
         },
 
         // Unalias
@@ -449,6 +475,23 @@ bool type_check_statement(CoreEnv& env, std::shared_ptr<Stmt> stmt) {
         [&](const Stmt::BehaviourCall& b) {
             auto actor_type = val_expr_type(env, b.actor);
             if(!actor_type) { return false; }
+            if(b.broadcast_count != nullptr) {
+                // The receivers are read while the message is sent, so the array must not change
+                const Type::Pointer* receivers_type = std::get_if<Type::Pointer>(&actor_type->t);
+                if(!receivers_type || !std::holds_alternative<Cap::Val>(receivers_type->cap.t)) {
+                    report_error_location(b.actor->source_span);
+                    std::cerr << "Broadcast receivers must be a val array of actors" << std::endl;
+                    return false;
+                }
+                actor_type = receivers_type->base_type;
+                auto count_type = val_expr_type(env, b.broadcast_count);
+                if(!count_type) { return false; }
+                if(!type_is_int(env.type_env.type_context, count_type)) {
+                    report_error_location(b.broadcast_count->source_span);
+                    std::cerr << "Number of broadcast receivers must be an int" << std::endl;
+                    return false;
+                }
+            }
             const Type::TActor* named_actor = std::get_if<Type::TActor>(&actor_type->t);
             if(!named_actor) {
                 report_error_location(stmt->source_span);
@@ -467,11 +510,31 @@ bool type_check_statement(CoreEnv& env, std::shared_ptr<Stmt> stmt) {
             }
             std::shared_ptr<TopLevelItem::Behaviour> called_behaviour 
                 = actor_behaviours[b.behaviour_name];
+            // Every receiver gets the same arguments, which an iso argument can not be shared as
+            for(const TopLevelItem::VarDecl& param: called_behaviour->params) {
+                const Type::Pointer* pointer_type = std::get_if<Type::Pointer>(&param.type->t);
+                if(b.broadcast_count != nullptr && pointer_type 
+                    && std::holds_alternative<Cap::Iso>(pointer_type->cap.t)) {
+                    report_error_location(stmt->source_span);
+                    std::cerr << "Behaviour " << b.behaviour_name 
+                        << " takes iso parameters, so it can not be broadcast" << std::endl;
+                    return false;
+                }
+            }
             if(!passed_in_parameters_valid(env, called_behaviour->params, b.args, true)) {
                 report_error_location(stmt->source_span);
                 std::cerr << "Passed in parameters to the behaviour are not valid" << std::endl;
                 return false;
             }
+            if(b.delay_ms != nullptr) {
+                auto delay_type = val_expr_type(env, b.delay_ms);
+                if(!delay_type) { return false; }
+                if(!type_is_int(env.type_env.type_context, delay_type)) {
+                    report_error_location(b.delay_ms->source_span);
+                    std::cerr << "Delay of a behaviour call must be an int" << std::endl;
+                    return false;
+                }
+            }
             return true;
         },
         [&](const Stmt::Print& print_expr) {
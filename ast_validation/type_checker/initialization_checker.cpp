@@ -53,7 +53,9 @@ bool valexpr_accesses_vars(const std::unordered_set<std::string>& vars, std::sha
             return valexpr_accesses_vars(vars, new_instance.init_expr) || valexpr_accesses_vars(vars, new_instance.size);
         },
         [&](const ValExpr::ActorConstruction& actor_construction) {
-            return valexpr_list_accesses_vars(vars, actor_construction.args);
+            return valexpr_list_accesses_vars(vars, actor_construction.args) || 
+                (actor_construction.bulk_size != nullptr && 
+                    valexpr_accesses_vars(vars, actor_construction.bulk_size));
         },
         [&](const ValExpr::Unalias& unalias) {
             if(vars.contains(unalias.var_name)) {
@@ -177,7 +179,10 @@ std::optional<std::unordered_set<std::string>> new_assigned_variable_in_stmt(
         [&](const Stmt::BehaviourCall& b) -> std::optional<std::unordered_set<std::string>> {
             // return valexpr_list_accesses_vars(vars, be_call.args);
             if(valexpr_accesses_uninitialized(env, unassigned_members, b.actor) 
-            || valexpr_list_accesses_uninitialized(env, unassigned_members, b.args)) {
+            || valexpr_list_accesses_uninitialized(env, unassigned_members, b.args)
+            || (b.delay_ms != nullptr && valexpr_accesses_uninitialized(env, unassigned_members, b.delay_ms))
+            || (b.broadcast_count != nullptr 
+                && valexpr_accesses_uninitialized(env, unassigned_members, b.broadcast_count))) {
                 return std::nullopt;
             }
             return new_assigned_var;
@@ -138,6 +138,12 @@ bool update_stmt_validity_info(
                     return false;
                 }
             }
+            if(be_call.delay_ms != nullptr && !update_valexpr_validity_info(var_valid, be_call.delay_ms)) {
+                return false;
+            }
+            if(be_call.broadcast_count != nullptr) {
+                return update_valexpr_validity_info(var_valid, be_call.broadcast_count);
+            }
             return true;
         },
         [&](const Stmt::Print& print_expr) {
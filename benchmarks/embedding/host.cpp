@@ -0,0 +1,37 @@
+// Measures the overhead of sending messages into a Coherence actor from a host thread.
+// Prints the total computed by the actor, followed by the mean cost of a send in ns. The behaviour
+// is resolved once, as hosts that send often do (see [coh_runtime_behaviour_index]).
+#include "coherence_runtime.h"
+// Written by the compiler next to out.o
+#include "out.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+int main(int argc, char* argv[]) {
+    const int num_sends = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    CohRuntimeConfig config{};
+    config.num_workers = 4;
+    coh_runtime_init(&config);
+    coh_runtime_start();
+    uint64_t main_actor = coh_runtime_main_actor();
+
+    int64_t add_index = coh_runtime_behaviour_index(main_actor, add_Main_be);
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < num_sends; i++) {
+        auto* message = static_cast<add_Main_be_struct*>(coh_alloc(sizeof(add_Main_be_struct)));
+        message->amount = 1;
+        message->this_id = main_actor;
+        coh_runtime_send_indexed(main_actor, message, add_index);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    auto* report = static_cast<report_Main_be_struct*>(coh_alloc(sizeof(report_Main_be_struct)));
+    report->this_id = main_actor;
+    coh_runtime_send(main_actor, report, report_Main_be);
+    coh_runtime_stop();
+
+    double total_ns = std::chrono::duration<double, std::nano>(end - start).count();
+    std::cout << total_ns / num_sends << std::endl;
+    return 0;
+}
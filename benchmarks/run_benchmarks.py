@@ -70,16 +70,19 @@ class BenchmarkConfig:
     ponyc: str
     output_dir: Path
     root_dir: Path
+    embed_lib: str
+    runtime_include_dir: str
 
 
-def compile_coherence(compiler: str, input_file: Path, output_dir: Path, optimize: bool = False):
+def compile_coherence(compiler: str, input_file: Path, output_dir: Path, optimize: bool = False,
+                      extra_flags: list[str] = None):
     """Compile a Coherence file and check for errors."""
     cmd = [
         compiler,
         "--input-file", str(input_file),
         "--output-dir", str(output_dir),
         "--optimize", "true" if optimize else "false"
-    ]
+    ] + (extra_flags or [])
     print(f"  Compiling: {' '.join(cmd)}")
     result = run(cmd, check=True)
     
@@ -195,6 +198,205 @@ def benchmark_ping_pong(config: BenchmarkConfig):
         plt.savefig(config.output_dir / "ping_pong_report.png")
         plt.close()
 
+def benchmark_jit_startup(config: BenchmarkConfig):
+    print("Benchmarking compile-and-run latency, executable vs JIT")
+
+    programs = [
+        config.root_dir / "tests" / "e2e_tests" / "functional_tests" / "simple" / "prog.coh",
+        config.root_dir / "tests" / "e2e_tests" / "functional_tests" / "locks" / "prog.coh",
+    ]
+    bin_dir = config.root_dir / "benchmarks" / "jit_startup" / "bin"
+
+    with temporary_directories(bin_dir):
+        with open(config.output_dir / "jit_startup_report.txt", "w") as f:
+            for prog in programs:
+                aot, _ = time_compilation([
+                    "sh", "-c",
+                    f"{config.compiler} --input-file {prog} --output-dir {bin_dir} && {bin_dir / 'out'}"
+                ])
+                jit, _ = time_compilation([config.compiler, "--input-file", str(prog), "--run", "true"])
+                f.write(f"{prog.parent.name}: executable {aot * 1000:.1f}ms, --run {jit * 1000:.1f}ms\n")
+    print("  Done.")
+
+def benchmark_embedding(config: BenchmarkConfig, num_sends: int = 1000000):
+    print("Benchmarking host -> actor send overhead")
+
+    embed_dir = config.root_dir / "benchmarks" / "embedding"
+    embed_coh = embed_dir / "prog.coh"
+    embed_host = embed_dir / "host.cpp"
+    bin_dir = embed_dir / "bin_embed"
+
+    with temporary_directories(bin_dir):
+        run([
+            config.compiler,
+            "--input-file", str(embed_coh),
+            "--output-dir", str(bin_dir),
+            "--emit-object", "true"
+        ], check=True)
+        host_exe = bin_dir / "host"
+        run([
+            "g++", "-std=c++20", "-O2", "-pthread",
+            "-I", config.runtime_include_dir, "-I", str(bin_dir),
+            str(embed_host), str(bin_dir / "out.o"), config.embed_lib,
+            "-lboost_context", "-o", str(host_exe)
+        ], check=True)
+
+        r = run([str(host_exe), str(num_sends)], check=True)
+        total, ns_per_send = r.stdout.split()
+        if int(total) != num_sends:
+            print(f"Embedded program computed {total}, expected {num_sends}")
+            sys.exit(1)
+        with open(config.output_dir / "embedding_report.txt", "w") as f:
+            f.write(f"coh_runtime_send_indexed: {float(ns_per_send):.1f} ns/call over {num_sends} calls\n")
+    print("  Done.")
+
+def benchmark_allocations(config: BenchmarkConfig, expected_total: int = 7984):
+    print("Benchmarking stack promotion of small arrays")
+
+    alloc_dir = config.root_dir / "benchmarks" / "allocations"
+    alloc_coh = alloc_dir / "prog.coh"
+    bin_dirs = {
+        "stack": alloc_dir / "bin_stack",
+        "heap": alloc_dir / "bin_heap",
+    }
+
+    with temporary_directories(*bin_dirs.values()):
+        results = {}
+        for variant, promote in [("stack", "true"), ("heap", "false")]:
+            compile_coherence(config.compiler, alloc_coh, bin_dirs[variant],
+                              extra_flags=["--stack-promotion", promote])
+            exe = str(bin_dirs[variant] / "out")
+            total = run([exe], check=True).stdout.split()
+            if total != [str(expected_total)]:
+                print(f"Allocation benchmark ({variant}) printed {total}, expected {expected_total}")
+                sys.exit(1)
+            results[variant] = time_exe([exe])
+
+        with open(config.output_dir / "allocations_report.txt", "w") as f:
+            for variant, flag in [("stack", "true"), ("heap", "false")]:
+                mean, std = results[variant]
+                f.write(f"--stack-promotion {flag}: {mean:.3f}s (std {std:.3f}s)\n")
+            f.write(f"speedup: {results['heap'][0] / results['stack'][0]:.2f}x\n")
+    print("  Done.")
+
+def benchmark_ssa_locals(config: BenchmarkConfig, expected_total: int = 10753712):
+    print("Benchmarking scalar locals in SSA registers")
+
+    loops_coh = config.root_dir / "benchmarks" / "loops" / "prog.coh"
+    bin_root = config.root_dir / "benchmarks" / "loops" / "bin"
+
+    with temporary_directories(bin_root):
+        with open(config.output_dir / "ssa_locals_report.txt", "w") as f:
+            for optimize in [False, True]:
+                for ssa in ["true", "false"]:
+                    bin_dir = bin_root / f"{str(optimize).lower()}_{ssa}"
+                    compile_coherence(config.compiler, loops_coh, bin_dir, optimize=optimize,
+                                      extra_flags=["--ssa-locals", ssa])
+                    exe = str(bin_dir / "out")
+                    total = run([exe], check=True).stdout.split()
+                    if total != [str(expected_total)]:
+                        print(f"Loops benchmark printed {total}, expected {expected_total}")
+                        sys.exit(1)
+                    mean, std = time_exe([exe])
+                    f.write(f"--optimize {str(optimize).lower()} --ssa-locals {ssa}: {mean:.3f}s (std {std:.3f}s)\n")
+    print("  Done.")
+
+def benchmark_alias_metadata(config: BenchmarkConfig, expected_checksum: int = 1760695712):
+    print("Benchmarking alias metadata")
+
+    kernel_coh = config.root_dir / "benchmarks" / "numeric_kernel" / "prog.coh"
+    bin_root = config.root_dir / "benchmarks" / "numeric_kernel" / "bin"
+
+    with temporary_directories(bin_root):
+        with open(config.output_dir / "alias_metadata_report.txt", "w") as f:
+            for alias_metadata in ["true", "false"]:
+                bin_dir = bin_root / alias_metadata
+                compile_coherence(config.compiler, kernel_coh, bin_dir, optimize=True,
+                                  extra_flags=["--alias-metadata", alias_metadata])
+                exe = str(bin_dir / "out")
+                checksum = run([exe], check=True).stdout.split()
+                if checksum != [str(expected_checksum)]:
+                    print(f"Numeric kernel benchmark printed {checksum}, expected {expected_checksum}")
+                    sys.exit(1)
+                mean, std = time_exe([exe])
+                f.write(f"--alias-metadata {alias_metadata}: {mean:.3f}s (std {std:.3f}s)\n")
+    print("  Done.")
+
+def benchmark_vectorization(config: BenchmarkConfig, expected_sum: int = 1932331904):
+    print("Benchmarking loop vectorization")
+
+    vector_coh = config.root_dir / "benchmarks" / "vector_loops" / "prog.coh"
+    bin_root = config.root_dir / "benchmarks" / "vector_loops" / "bin"
+
+    with temporary_directories(bin_root):
+        with open(config.output_dir / "vectorization_report.txt", "w") as f:
+            for alias_metadata in ["true", "false"]:
+                bin_dir = bin_root / alias_metadata
+                compile_coherence(config.compiler, vector_coh, bin_dir, optimize=True,
+                                  extra_flags=["--alias-metadata", alias_metadata, "--emit-llvm", "true"])
+                exe = str(bin_dir / "out")
+                total = run([exe], check=True).stdout.split()
+                if total != [str(expected_sum)]:
+                    print(f"Vector loops benchmark printed {total}, expected {expected_sum}")
+                    sys.exit(1)
+                vector_loops = (bin_dir / "out_opt.ll").read_text().count("vector.body:")
+                mean, std = time_exe([exe])
+                f.write(f"--alias-metadata {alias_metadata}: {vector_loops} vectorized loops, "
+                        f"{mean:.3f}s (std {std:.3f}s)\n")
+    print("  Done.")
+
+def benchmark_dispatch(config: BenchmarkConfig, expected_state: int = 600905):
+    print("Benchmarking behaviour dispatch")
+
+    dispatch_coh = config.root_dir / "benchmarks" / "dispatch" / "prog.coh"
+    bin_root = config.root_dir / "benchmarks" / "dispatch" / "bin"
+
+    with temporary_directories(bin_root):
+        with open(config.output_dir / "dispatch_report.txt", "w") as f:
+            for single_threaded in ["false", "true"]:
+                for direct_dispatch in ["true", "false"]:
+                    bin_dir = bin_root / f"{single_threaded}_{direct_dispatch}"
+                    compile_coherence(config.compiler, dispatch_coh, bin_dir, optimize=True,
+                                      extra_flags=["--single-threaded", single_threaded,
+                                                   "--direct-dispatch", direct_dispatch])
+                    exe = str(bin_dir / "out")
+                    state = run([exe], check=True).stdout.split()
+                    if state != [str(expected_state)]:
+                        print(f"Dispatch benchmark printed {state}, expected {expected_state}")
+                        sys.exit(1)
+                    mean, std = time_exe([exe])
+                    f.write(f"--single-threaded {single_threaded} --direct-dispatch {direct_dispatch}: "
+                            f"{mean:.3f}s (std {std:.3f}s)\n")
+    print("  Done.")
+
+ALLOCATORS = ["actor-heap", "libc", "size-class", "bump"]
+
+def benchmark_allocators(config: BenchmarkConfig):
+    print("Benchmarking allocator backends")
+
+    programs = {
+        "ping_pong": config.root_dir / "benchmarks" / "ping_pong" / "coherence_implementation" / "prog.coh",
+        "message_storm": config.root_dir / "tests" / "e2e_tests" / "concurrency_tests" / "message_storm" / "prog.coh",
+        "allocations": config.root_dir / "benchmarks" / "allocations" / "prog.coh",
+    }
+    bin_root = config.root_dir / "benchmarks" / "bin_allocators"
+
+    with temporary_directories(bin_root):
+        results = {}
+        for program, source in programs.items():
+            for allocator in ALLOCATORS:
+                bin_dir = bin_root / f"{program}_{allocator}"
+                compile_coherence(config.compiler, source, bin_dir,
+                                  extra_flags=["--allocator", allocator])
+                results[(program, allocator)] = time_exe([str(bin_dir / "out")])
+
+        with open(config.output_dir / "allocators_report.txt", "w") as f:
+            f.write(f"{'program':<16}" + "".join(f"{a:>14}" for a in ALLOCATORS) + "\n")
+            for program in programs:
+                row = "".join(f"{results[(program, a)][0]:>13.3f}s" for a in ALLOCATORS)
+                f.write(f"{program:<16}{row}\n")
+    print("  Done.")
+
 def get_func_str(n: int):
     return f"""
 func f{n}() => unit {{
@@ -270,6 +472,34 @@ def benchmark_compilation_time(config: BenchmarkConfig, sizes: list[int] = None)
         plt.close()
     print("  Done.")
 
+def benchmark_full_compilation_time(config: BenchmarkConfig, sizes: list[int] = None):
+    print("Benchmarking compilation time down to an executable")
+
+    if sizes is None:
+        sizes = [500, 1000, 2000]
+
+    compile_dir = config.root_dir / "benchmarks" / "compilation_time"
+    bin_dir = compile_dir / "bin"
+
+    with temporary_directories(compile_dir, bin_dir):
+        with open(config.output_dir / "full_compilation_time_report.txt", "w") as f:
+            for n in sizes:
+                source_file = compile_dir / f"phi_{n}.coh"
+                generate_phi(n, source_file)
+                for optimize in ["false", "true"]:
+                    # A single module on one thread, then the default of one partition per core
+                    for jobs in [["--jobs", "1"], []]:
+                        cmd = [
+                            config.compiler,
+                            "--input-file", str(source_file),
+                            "--output-dir", str(bin_dir),
+                            "--optimize", optimize,
+                            *jobs,
+                        ]
+                        mean, std = time_compilation(cmd)
+                        f.write(f"n={n} --optimize {optimize} {' '.join(jobs)}: {mean:.3f}s (std {std:.3f}s)\n")
+    print("  Done.")
+
 
 def main():
     parser = argparse.ArgumentParser(description="Run Coherence benchmarks")
@@ -277,13 +507,17 @@ def main():
     parser.add_argument("--ponyc", required=True, help="Path to ponyc")
     parser.add_argument("--output-dir", required=True, help="Directory for benchmark reports")
     parser.add_argument("--root-dir", required=True, help="Project root directory")
+    parser.add_argument("--embed-lib", required=True, help="Path to the coherence_embed library")
+    parser.add_argument("--runtime-include-dir", required=True, help="Directory containing coherence_runtime.h")
     args = parser.parse_args()
 
     config = BenchmarkConfig(
         compiler=args.compiler,
         ponyc=args.ponyc,
         output_dir=Path(args.output_dir),
-        root_dir=Path(args.root_dir)
+        root_dir=Path(args.root_dir),
+        embed_lib=args.embed_lib,
+        runtime_include_dir=args.runtime_include_dir
     )
     
     config.output_dir.mkdir(parents=True, exist_ok=True)
@@ -294,6 +528,15 @@ def main():
     
     benchmark_ping_pong(config)
     benchmark_compilation_time(config)
+    benchmark_full_compilation_time(config)
+    benchmark_jit_startup(config)
+    benchmark_embedding(config)
+    benchmark_allocations(config)
+    benchmark_allocators(config)
+    benchmark_ssa_locals(config)
+    benchmark_alias_metadata(config)
+    benchmark_vectorization(config)
+    benchmark_dispatch(config)
     sys.exit(0)
 
 
@@ -0,0 +1,261 @@
+#include "callable_attributes.hpp"
+#include "codegen_utils.hpp"
+#include "pattern_matching_boilerplate.hpp"
+#include "ast_walkers.hpp"
+#include <algorithm>
+#include <functional>
+
+// The llvm name of the function [func_name] refers to inside [gen_state.curr_actor]: members of
+// the actor hide the top-level functions
+static std::string llvm_name_of_called_func(GenState& gen_state, const std::string& func_name) {
+    std::shared_ptr<TopLevelItem::Actor> curr_actor = gen_state.curr_actor;
+    if(curr_actor != nullptr) {
+        for(auto& actor_mem: curr_actor->actor_members) {
+            auto member_func = std::get_if<std::shared_ptr<TopLevelItem::Func>>(&actor_mem);
+            if(member_func != nullptr && (*member_func)->name == func_name) {
+                return llvm_name_of_func(gen_state, func_name);
+            }
+        }
+    }
+    gen_state.curr_actor = nullptr;
+    std::string llvm_name = llvm_name_of_func(gen_state, func_name);
+    gen_state.curr_actor = curr_actor;
+    return llvm_name;
+}
+
+std::unordered_set<std::string> collect_referenced_symbols(
+    GenState& gen_state,
+    const CodegenPartition& codegen_partition) {
+    std::unordered_set<std::string> referenced;
+    auto valexpr_action = [&](std::shared_ptr<ValExpr> val_expr) {
+        std::visit(Overload{
+            [&](const ValExpr::FuncCall& func_call) {
+                referenced.insert(llvm_name_of_called_func(gen_state, func_call.func));
+            },
+            [&](const ValExpr::ActorConstruction& actor_construction) {
+                referenced.insert(llvm_name_of_constructor(
+                    actor_construction.constructor_name,
+                    actor_construction.actor_name));
+                referenced.insert(llvm_name_of_actor_descriptor(actor_construction.actor_name));
+            },
+            [&](const auto&) {}
+        }, val_expr->t);
+    };
+    auto stmt_action = [&](std::shared_ptr<Stmt> stmt) {};
+    for(std::shared_ptr<TopLevelItem::Func> func_def: codegen_partition.funcs) {
+        walk_callable_body(func_def->body, valexpr_action, stmt_action);
+    }
+    for(std::shared_ptr<TopLevelItem::Actor> actor_def: codegen_partition.actors) {
+        gen_state.curr_actor = actor_def;
+        for(auto& actor_mem: actor_def->actor_members) {
+            std::visit([&](const auto& member_def) {
+                walk_callable_body(member_def->body, valexpr_action, stmt_action);
+            }, actor_mem);
+        }
+        gen_state.curr_actor = nullptr;
+    }
+    // [start.runtime] creates [Main]
+    if(codegen_partition.has_entry_points) {
+        referenced.insert(llvm_name_of_constructor("create", "Main"));
+        referenced.insert(llvm_name_of_actor_descriptor("Main"));
+    }
+    return referenced;
+}
+
+// Ordered, so that the effect of several accesses is the largest one
+enum class MemoryEffect {
+    NONE,
+    READ,
+    READ_WRITE
+};
+
+struct CallableEffects {
+    MemoryEffect memory = MemoryEffect::NONE;
+    // Whether the callable may not return: it loops, recurses or waits for locks
+    bool may_diverge = false;
+    // By llvm name
+    std::unordered_set<std::string> callees;
+};
+
+// What the body of a function or constructor may do itself, and what it calls
+static CallableEffects local_callable_effects(
+    GenState& gen_state,
+    const std::vector<TopLevelItem::VarDecl>& params,
+    std::vector<std::shared_ptr<Stmt>>& body,
+    bool recursive) {
+    CallableEffects effects;
+    effects.may_diverge = recursive;
+    auto access = [&](MemoryEffect memory) {
+        effects.memory = std::max(effects.memory, memory);
+    };
+    // Variables that live in the callable's frame. Any other variable is a member of the actor.
+    std::unordered_map<std::string, std::shared_ptr<const Type>> locals = collect_local_variable_types(body);
+    for(const TopLevelItem::VarDecl& param: params) {
+        locals.emplace(param.name, param.type);
+    }
+    // Actor references are counted by the runtime
+    for(const auto& [var, type]: locals) {
+        if(llvm_type_holds_actors(llvm_type_of_coh_type(gen_state, type))) {
+            access(MemoryEffect::READ_WRITE);
+        }
+    }
+    std::function<bool(std::shared_ptr<ValExpr>)> is_local_location;
+    is_local_location = [&](std::shared_ptr<ValExpr> lhs) {
+        return std::visit(Overload{
+            [&](const ValExpr::VVar& var) {
+                return locals.contains(var.name);
+            },
+            [&](const ValExpr::Field& field) {
+                return is_local_location(field.base);
+            },
+            [&](const auto&) {
+                return false;
+            }
+        }, lhs->t);
+    };
+    auto valexpr_action = [&](std::shared_ptr<ValExpr> val_expr) {
+        if(val_expr->expr_type != nullptr && 
+            llvm_type_holds_actors(llvm_type_of_coh_type(gen_state, val_expr->expr_type))) {
+            access(MemoryEffect::READ_WRITE);
+        }
+        std::visit(Overload{
+            [&](const ValExpr::VVar& var) {
+                if(!locals.contains(var.name)) {
+                    access(MemoryEffect::READ);
+                }
+            },
+            [&](const ValExpr::Unalias& unalias) {
+                if(!locals.contains(unalias.var_name)) {
+                    access(MemoryEffect::READ);
+                }
+            },
+            [&](const ValExpr::PointerAccess&) {
+                access(MemoryEffect::READ);
+            },
+            [&](const ValExpr::Assignment& assignment) {
+                if(!is_local_location(assignment.lhs)) {
+                    access(MemoryEffect::READ_WRITE);
+                }
+            },
+            [&](const ValExpr::NewInstance&) {
+                access(MemoryEffect::READ_WRITE);
+            },
+            [&](const ValExpr::ActorConstruction& actor_construction) {
+                access(MemoryEffect::READ_WRITE);
+                // Single and bulk construction both run the constructor, which may not return
+                effects.callees.insert(llvm_name_of_constructor(
+                    actor_construction.constructor_name,
+                    actor_construction.actor_name));
+            },
+            [&](const ValExpr::FuncCall& func_call) {
+                effects.callees.insert(llvm_name_of_called_func(gen_state, func_call.func));
+            },
+            [&](const auto&) {}
+        }, val_expr->t);
+    };
+    auto stmt_action = [&](std::shared_ptr<Stmt> stmt) {
+        std::visit(Overload{
+            [&](const Stmt::MemberInitialize&) {
+                access(MemoryEffect::READ_WRITE);
+            },
+            [&](const Stmt::BehaviourCall&) {
+                access(MemoryEffect::READ_WRITE);
+            },
+            [&](const Stmt::Print&) {
+                access(MemoryEffect::READ_WRITE);
+            },
+            [&](const Stmt::While&) {
+                effects.may_diverge = true;
+            },
+            [&](const std::shared_ptr<Stmt::Atomic>&) {
+                access(MemoryEffect::READ_WRITE);
+                effects.may_diverge = true;
+            },
+            [&](const auto&) {}
+        }, stmt->t);
+    };
+    walk_callable_body(body, valexpr_action, stmt_action);
+    return effects;
+}
+
+std::unordered_map<std::string, std::string> infer_callable_attributes(
+    GenState& gen_state,
+    Program* program_ast) {
+    std::unordered_map<std::string, CallableEffects> callable_effects;
+    std::unordered_map<std::string, bool> callable_recursive;
+    auto add_func = [&](std::shared_ptr<TopLevelItem::Func> func_def) {
+        std::string llvm_name = llvm_name_of_func(gen_state, func_def->name);
+        callable_effects.emplace(llvm_name,
+            local_callable_effects(gen_state, func_def->params, func_def->body, func_def->recursive));
+        callable_recursive.emplace(llvm_name, func_def->recursive);
+    };
+    for(const TopLevelItem& top_level_item: program_ast->top_level_items) {
+        std::visit(Overload{
+            [&](const TopLevelItem::TypeDef&) {},
+            [&](std::shared_ptr<TopLevelItem::Func> func_def) {
+                add_func(func_def);
+            },
+            [&](std::shared_ptr<TopLevelItem::Actor> actor_def) {
+                gen_state.curr_actor = actor_def;
+                for(auto& actor_mem: actor_def->actor_members) {
+                    std::visit(Overload{
+                        [&](std::shared_ptr<TopLevelItem::Func> func_def) {
+                            add_func(func_def);
+                        },
+                        [&](std::shared_ptr<TopLevelItem::Constructor> constr_def) {
+                            std::string llvm_name = llvm_name_of_constructor(constr_def->name, actor_def->name);
+                            callable_effects.emplace(llvm_name, local_callable_effects(
+                                gen_state, constr_def->params, constr_def->body, constr_def->recursive));
+                            callable_recursive.emplace(llvm_name, constr_def->recursive);
+                        },
+                        [&](std::shared_ptr<TopLevelItem::Behaviour>) {}
+                    }, actor_mem);
+                }
+                gen_state.curr_actor = nullptr;
+            }
+        }, top_level_item.t);
+    }
+
+    // A callable does whatever its callees do. Effects only grow, so this reaches a fixpoint.
+    bool changed = true;
+    while(changed) {
+        changed = false;
+        for(auto& [llvm_name, effects]: callable_effects) {
+            for(const std::string& callee: effects.callees) {
+                const CallableEffects& callee_effects = callable_effects.at(callee);
+                if(callee_effects.memory > effects.memory) {
+                    effects.memory = callee_effects.memory;
+                    changed = true;
+                }
+                if(callee_effects.may_diverge && !effects.may_diverge) {
+                    effects.may_diverge = true;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    std::unordered_map<std::string, std::string> callable_attributes;
+    for(const auto& [llvm_name, effects]: callable_effects) {
+        // Coherence has no exceptions, and the runtime does not unwind into generated code
+        std::string attributes = "nounwind";
+        if(!callable_recursive.at(llvm_name)) {
+            attributes += " norecurse";
+        }
+        if(!effects.may_diverge) {
+            attributes += " willreturn";
+        }
+        switch(effects.memory) {
+            case MemoryEffect::NONE:
+                attributes += " readnone";
+                break;
+            case MemoryEffect::READ:
+                attributes += " readonly";
+                break;
+            case MemoryEffect::READ_WRITE:
+                break;
+        }
+        callable_attributes.emplace(llvm_name, attributes);
+    }
+    return callable_attributes;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include "codegen.hpp"
+#include "generator_state.hpp"
+
+// The llvm names of the functions, constructors and actor descriptors the code of
+// [codegen_partition] references
+std::unordered_set<std::string> collect_referenced_symbols(
+    GenState& gen_state,
+    const CodegenPartition& codegen_partition);
+
+// Function attributes of every function and constructor of [program_ast], by llvm name. They
+// follow from what the callable and everything it calls may do: access memory, loop or recurse
+// (see [TopLevelItem::Func::recursive]).
+std::unordered_map<std::string, std::string> infer_callable_attributes(
+    GenState& gen_state,
+    Program* program_ast);
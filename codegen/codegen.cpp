@@ -1,5 +1,6 @@
 #include "codegen.hpp"
 #include "alpha_renaming.hpp"
+#include "callable_attributes.hpp"
 #include "codegen_utils.hpp"
 #include "pattern_matching_boilerplate.hpp"
 #include "string_utils.hpp"
@@ -8,13 +9,33 @@
 #include "generate_llvm_structs.hpp"
 #include "special_reg_names.hpp"
 #include "defer.cpp"
+#include "ast_walkers.hpp"
 #include <assert.h>
+#include <algorithm>
+#include <cctype>
+#include <numeric>
+#include <set>
+#include <unordered_set>
 #include <variant>
 #include <sstream>
 #include <fstream>
 
 enum class ValueCategory { LVALUE, RVALUE };
 
+// Top-level functions are spread over the partitions in chunks of this many
+static constexpr size_t FUNCTIONS_PER_CHUNK = 32;
+
+// Linkage and calling convention the definition of the callable [llvm_name] starts with
+std::string llvm_callable_linkage(GenState& gen_state, const std::string& llvm_name) {
+    const CodegenPlan::CallableInfo& callable_info = gen_state.plan->callables.at(llvm_name);
+    return std::string(callable_info.internal ? "internal " : "") + (callable_info.fastcc ? "fastcc " : "");
+}
+
+// Calling convention of the calls to the callable [llvm_name]
+std::string llvm_calling_convention(GenState& gen_state, const std::string& llvm_name) {
+    return gen_state.plan->callables.at(llvm_name).fastcc ? "fastcc " : "";
+}
+
 std::string convert_to_rvalue(
     GenState &gen_state, 
     const std::string& llvm_type, 
@@ -30,7 +51,7 @@ std::string convert_to_rvalue(
                 pointer_type += "*";
             }
             gen_state.out_stream << "%" + temp_reg << " = load " << llvm_type << ", " << pointer_type
-            << " " << "%" + reg_name << std::endl;
+            << " " << "%" + reg_name << tbaa_annotation(gen_state, llvm_type, reg_name) << std::endl;
             return temp_reg;
     }
     assert(false);
@@ -83,6 +104,10 @@ std::pair<std::string, ValueCategory> emit_valexpr(
                     THIS_ACTOR_ID_REG,
                     ValueCategory::RVALUE);
             }
+            auto ssa_value = gen_state.ssa_var_values.find(var.name);
+            if(ssa_value != gen_state.ssa_var_values.end()) {
+                return make_pair(ssa_value->second, ValueCategory::RVALUE);
+            }
             return make_pair(
                 gen_state.var_reg_mapping.at(var.name), 
                 ValueCategory::LVALUE);
@@ -140,84 +165,210 @@ std::pair<std::string, ValueCategory> emit_valexpr(
                     size_expr_cat);
             std::string size64_reg = convert_i32_to_i64(gen_state, size_val_reg_rval);
 
-            // Getting the llvm type of the internal object
-            std::string allocated_obj_type = 
-                llvm_type_of_coh_type(gen_state, new_instance.type)->llvm_type_name;
-            
             // Getting the number of bytes
-            std::string type_size = get_llvm_type_size(gen_state, allocated_obj_type);
+            std::shared_ptr<LLVMTypeInfo> elem_type_info = llvm_type_of_coh_type(gen_state, new_instance.type);
+            std::string type_size = get_llvm_type_size(gen_state, elem_type_info->llvm_type_name);
             std::string num_bytes_reg = gen_state.reg_label_gen.new_temp_reg();
             // %<num_bytes_reg> = mul i64 %<size64_reg>, %<type_size>
             gen_state.out_stream << "%" << num_bytes_reg << " = mul i64 " << "%" 
             << size64_reg << ", " << "%" << type_size << std::endl;
 
-            // Performing the malloc
-            // %<pointer_reg> = call ptr @malloc(i64 %<num_bytes_reg>)
-            std::string pointer_reg = gen_state.reg_label_gen.new_temp_reg();
-            gen_state.out_stream << "%" << pointer_reg << " = call ptr @malloc(i64 " << 
-            "%" << num_bytes_reg << ")" << std::endl;
-
-            // Loop to fill out the default value at all indices
-            /*
-            br label %fill.preheader
+            // A default made of zero bits does not have to be stored element by element
+            bool zero_default = is_zero_constant(new_instance.init_expr);
+            std::string pointer_reg;
+            auto frame_slot = gen_state.frame_array_slots.find(&new_instance);
+            if(frame_slot != gen_state.frame_array_slots.end()) {
+                // The array lives in the callable's frame. Its slot was allocated in the entry block.
+                pointer_reg = frame_slot->second;
+                gen_state.out_stream << "call void @llvm.lifetime.start.p0(i64 -1, ptr " << "%" + pointer_reg 
+                << ")" << std::endl;
+            }
+            else {
+                // Performing the allocation, from the behaviour's arena if the memory can not escape.
+                // Heap blocks can come zeroed from the allocator (large ones straight from calloc).
+                // %<pointer_reg> = call ptr @<alloc_fn>(i64 %<num_bytes_reg>)
+                pointer_reg = gen_state.reg_label_gen.new_temp_reg();
+                std::string alloc_fn = new_instance.arena_allocated ? "coh_arena_alloc" : 
+                    zero_default ? "coh_alloc_zeroed" : "coh_alloc";
+                gen_state.out_stream << "%" << pointer_reg << " = call ptr @" << alloc_fn << "(i64 " << 
+                "%" << num_bytes_reg << ")" << std::endl;
+                if(zero_default && !new_instance.arena_allocated) {
+                    return make_pair(pointer_reg, ValueCategory::RVALUE);
+                }
+            }
 
-            fill.preheader:
-            br label %fill.cond
+            if(zero_default) {
+                gen_state.out_stream << "call void @llvm.memset.p0.i64(ptr " << "%" + pointer_reg << ", i8 0, i64 "
+                << "%" + num_bytes_reg << ", i1 false)" << std::endl;
+                return make_pair(pointer_reg, ValueCategory::RVALUE);
+            }
 
-            fill.cond:
-            %i = phi i64 [ 0, %fill.preheader ], [ %i.next, %fill.body ]
-            %cmp = icmp ult i64 %i, %n
-            br i1 %cmp, label %fill.body, label %fill.end
+            // Store the default into the first element and let the runtime replicate it, which
+            // copies in blocks of doubling size instead of storing one element at a time
+            /*
+            %nonempty = icmp ne i64 %n, 0
+            br i1 %nonempty, label %fill, label %fill.end
 
-            fill.body:
-            %elem.ptr = getelementptr T, ptr %base, i64 %i
-            store T %def, ptr %elem.ptr
-            %i.next = add i64 %i, 1
-            br label %fill.cond
+            fill:
+            store T %def, ptr %base
+            call void @coh_fill_array(ptr %base, i64 %elem_size, i64 %n)
+            br label %fill.end
 
             fill.end:
             */
-            std::string ind_preheader_label = gen_state.reg_label_gen.new_label();
-            std::string ind_comp_label = gen_state.reg_label_gen.new_label();
-            std::string fill_body_label = gen_state.reg_label_gen.new_label();
+            std::string fill_label = gen_state.reg_label_gen.new_label();
             std::string fill_end_label = gen_state.reg_label_gen.new_label();
-            branch_label(gen_state, ind_preheader_label);
-            gen_state.out_stream << ind_preheader_label << ":" << std::endl;
-            branch_label(gen_state, ind_comp_label);
-            gen_state.out_stream << ind_comp_label << ":" << std::endl;
-            std::string ind_reg = gen_state.reg_label_gen.new_temp_reg();
-            std::string next_ind_reg = gen_state.reg_label_gen.new_temp_reg();
-            gen_state.out_stream << "%" + ind_reg << " = phi i64 [ 0, %" + ind_preheader_label << " ], [ "
-            << "%" + next_ind_reg << ", %" + fill_body_label + " ]" << std::endl;
-            std::string size_cmp_result = gen_state.reg_label_gen.new_temp_reg();
-            gen_state.out_stream << "%" + size_cmp_result << " = icmp ult i64 " << "%" + ind_reg << ", "
-            << "%" + size64_reg << std::endl;
-            gen_state.out_stream << "br i1 " << "%" + size_cmp_result << ", label " << "%" + fill_body_label 
+            std::string nonempty_reg = gen_state.reg_label_gen.new_temp_reg();
+            gen_state.out_stream << "%" + nonempty_reg << " = icmp ne i64 " << "%" + size64_reg << ", 0" << std::endl;
+            gen_state.out_stream << "br i1 " << "%" + nonempty_reg << ", label " << "%" + fill_label 
             << ", label " << "%" + fill_end_label << std::endl;
-            gen_state.out_stream << fill_body_label << ":" << std::endl;
-            std::string arr_ele_reg = gen_state.reg_label_gen.new_temp_reg();
-            gen_state.out_stream << "%" + arr_ele_reg << " = getelementptr " << llvm_type_of_default << ", ptr "
-            << "%" + pointer_reg << ", i64 " << "%" + ind_reg << std::endl;
+            emit_label(gen_state, fill_label);
+            gen_state.pointer_memory_kinds.emplace(pointer_reg, MemoryKind::ARRAY_ELEMENT);
             gen_state.out_stream << "store " << llvm_type_of_default << " " << "%" + default_val_reg_rval 
-            << ", ptr " << "%" + arr_ele_reg << std::endl;
-            gen_state.out_stream << "%" + next_ind_reg << " = add i64 " << "%" + ind_reg << ", 1" << std::endl;
-            branch_label(gen_state, ind_comp_label);
-            gen_state.out_stream << fill_end_label << ":" << std::endl; 
+            << ", ptr " << "%" + pointer_reg << tbaa_annotation(gen_state, llvm_type_of_default, pointer_reg) 
+            << std::endl;
+            gen_state.out_stream << "call void @coh_fill_array(ptr " << "%" + pointer_reg << ", i64 "
+            << "%" + type_size << ", i64 " << "%" + size64_reg << ")" << std::endl;
+            // Every element holds its own reference to the actors in the default value, taken in
+            // one go for the whole array
+            emit_actor_ref_update(
+                gen_state,
+                "actor_retain_many",
+                llvm_type_of_coh_type(gen_state, new_instance.init_expr->expr_type),
+                default_val_reg_rval,
+                size64_reg);
+            branch_label(gen_state, fill_end_label);
+            emit_label(gen_state, fill_end_label);
             return make_pair(pointer_reg, ValueCategory::RVALUE);
         },
         [&](const ValExpr::ActorConstruction& actor_construction) {
+            std::string constr_func_name_llvm = 
+                llvm_name_of_constructor(actor_construction.constructor_name, actor_construction.actor_name);
+            if(actor_construction.bulk_size != nullptr) {
+                // 1. Compile the size and the arguments, which every constructor receives. A
+                // negative size creates no actors.
+                std::string size_reg = emit_valexpr_rvalue(gen_state, actor_construction.bulk_size);
+                std::string size64_reg = convert_count_to_i64(gen_state, size_reg);
+                std::vector<std::pair<std::string, std::string>> func_args;
+                for(std::shared_ptr<ValExpr> arg_expr: actor_construction.args) {
+                    std::string llvm_type = 
+                        llvm_type_of_coh_type(gen_state, arg_expr->expr_type)->llvm_type_name;
+                    func_args.push_back({llvm_type, emit_valexpr_rvalue(gen_state, arg_expr)});
+                }
+
+                // 2. Register all the actors at once. They get consecutive ids starting at [first_id_reg].
+                std::string struct_size_reg = 
+                    get_llvm_type_size(gen_state, "%" + llvm_struct_of_actor(actor_construction.actor_name));
+                std::string first_id_reg = gen_state.reg_label_gen.new_temp_reg();
+                gen_state.out_stream << "%" + first_id_reg << " = call i64 @handle_bulk_actor_creation(i64 "
+                << "%" + size64_reg << ", i64 " << "%" + struct_size_reg << ", ptr @" 
+                << llvm_name_of_actor_descriptor(actor_construction.actor_name) << ")" << std::endl;
+                // The structs are laid out one after the other, each rounded up to 8 bytes (see
+                // [handle_bulk_actor_creation]), so only the first one has to be looked up
+                std::string first_struct_reg = gen_state.reg_label_gen.new_temp_reg();
+                gen_state.out_stream << "%" + first_struct_reg << " = call ptr @get_instance_struct(i64 "
+                << "%" + first_id_reg << ")" << std::endl;
+                std::string padded_size_reg = gen_state.reg_label_gen.new_temp_reg();
+                gen_state.out_stream << "%" + padded_size_reg << " = add i64 " << "%" + struct_size_reg << ", 7" 
+                << std::endl;
+                std::string stride_reg = gen_state.reg_label_gen.new_temp_reg();
+                gen_state.out_stream << "%" + stride_reg << " = and i64 " << "%" + padded_size_reg << ", -8" 
+                << std::endl;
+
+                // 3. Allocate the array of ids, which takes over the reference each actor starts with
+                std::string num_bytes_reg = gen_state.reg_label_gen.new_temp_reg();
+                gen_state.out_stream << "%" + num_bytes_reg << " = mul i64 " << "%" + size64_reg << ", 8" << std::endl;
+                std::string array_reg = gen_state.reg_label_gen.new_temp_reg();
+                gen_state.out_stream << "%" + array_reg << " = call ptr @coh_alloc(i64 " << "%" + num_bytes_reg 
+                << ")" << std::endl;
+
+                // 4. Store every id and run its constructor
+                /*
+                br label %constr.preheader
+
+                constr.preheader:
+                br label %constr.cond
+
+                constr.cond:
+                %i = phi i64 [ 0, %constr.preheader ], [ %i.next, %constr.body ]
+                %cmp = icmp ult i64 %i, %n
+                br i1 %cmp, label %constr.body, label %constr.end
+
+                constr.body:
+                %id = add i64 %first_id, %i
+                %elem.ptr = getelementptr i64, ptr %array, i64 %i
+                store i64 %id, ptr %elem.ptr
+                %offset = mul i64 %i, %stride
+                %struct = getelementptr i8, ptr %first_struct, i64 %offset
+                call void @<constructor>(<args>, i64 %id, ptr %struct, i64 %<sync_id>)
+                %i.next = add i64 %i, 1
+                br label %constr.cond
+
+                constr.end:
+                */
+                std::string preheader_label = gen_state.reg_label_gen.new_label();
+                std::string cond_label = gen_state.reg_label_gen.new_label();
+                std::string body_label = gen_state.reg_label_gen.new_label();
+                std::string end_label = gen_state.reg_label_gen.new_label();
+                branch_label(gen_state, preheader_label);
+                emit_label(gen_state, preheader_label);
+                branch_label(gen_state, cond_label);
+                emit_label(gen_state, cond_label);
+                std::string ind_reg = gen_state.reg_label_gen.new_temp_reg();
+                std::string next_ind_reg = gen_state.reg_label_gen.new_temp_reg();
+                gen_state.out_stream << "%" + ind_reg << " = phi i64 [ 0, %" + preheader_label << " ], [ "
+                << "%" + next_ind_reg << ", %" + body_label + " ]" << std::endl;
+                std::string cmp_reg = gen_state.reg_label_gen.new_temp_reg();
+                gen_state.out_stream << "%" + cmp_reg << " = icmp ult i64 " << "%" + ind_reg << ", "
+                << "%" + size64_reg << std::endl;
+                gen_state.out_stream << "br i1 " << "%" + cmp_reg << ", label " << "%" + body_label 
+                << ", label " << "%" + end_label << std::endl;
+                emit_label(gen_state, body_label);
+                std::string actor_id_reg = gen_state.reg_label_gen.new_temp_reg();
+                gen_state.out_stream << "%" + actor_id_reg << " = add i64 " << "%" + first_id_reg << ", "
+                << "%" + ind_reg << std::endl;
+                std::string elem_ptr_reg = gen_state.reg_label_gen.new_temp_reg();
+                gen_state.out_stream << "%" + elem_ptr_reg << " = getelementptr i64, ptr " << "%" + array_reg 
+                << ", i64 " << "%" + ind_reg << std::endl;
+                gen_state.pointer_memory_kinds.emplace(elem_ptr_reg, MemoryKind::ARRAY_ELEMENT);
+                gen_state.out_stream << "store i64 " << "%" + actor_id_reg << ", ptr " << "%" + elem_ptr_reg 
+                << tbaa_annotation(gen_state, "i64", elem_ptr_reg) << std::endl;
+                std::string offset_reg = gen_state.reg_label_gen.new_temp_reg();
+                gen_state.out_stream << "%" + offset_reg << " = mul i64 " << "%" + ind_reg << ", " 
+                << "%" + stride_reg << std::endl;
+                std::string actor_struct_reg = gen_state.reg_label_gen.new_temp_reg();
+                gen_state.out_stream << "%" + actor_struct_reg << " = getelementptr i8, ptr " 
+                << "%" + first_struct_reg << ", i64 " << "%" + offset_reg << std::endl;
+                func_args.push_back({"i64", actor_id_reg});
+                func_args.push_back({"ptr", actor_struct_reg});
+                func_args.push_back({"i64", SYNCHRONOUS_ACTOR_ID_REG});
+                gen_state.out_stream << "call " << llvm_calling_convention(gen_state, constr_func_name_llvm) 
+                << "void @" << constr_func_name_llvm << "(";
+                map_emit_list<std::pair<std::string, std::string>>(
+                    gen_state.out_stream,
+                    func_args,
+                    ", ",
+                    [](std::pair<std::string, std::string> p) {
+                        return p.first + " %" + p.second;
+                    }
+                );
+                gen_state.out_stream << ")" << std::endl;
+                gen_state.out_stream << "%" + next_ind_reg << " = add i64 " << "%" + ind_reg << ", 1" << std::endl;
+                branch_label(gen_state, cond_label);
+                emit_label(gen_state, end_label);
+                return make_pair(array_reg, ValueCategory::RVALUE);
+            }
+
             // 1. Allocate space on the heap for the actor struct
-            std::string actor_struct_type = "%" + llvm_struct_of_actor(actor_construction.actor_name);
-            std::string actor_struct_size = get_llvm_type_size(gen_state, actor_struct_type);
-            std::string actor_struct_ptr = gen_state.reg_label_gen.new_temp_reg();
-            // %<actor_struct_ptr> = call ptr @malloc(i64 %<actor_struct_size>)
-            gen_state.out_stream << "%" << actor_struct_ptr << " = call ptr @malloc(i64 "
-            << "%" << actor_struct_size << ")" << std::endl;
+            std::string actor_struct_ptr = allocate_actor_struct(gen_state, actor_construction.actor_name);
             
-            // 2. Register the actor by calling [handle_actor_creation]
+            // 2. Register the actor by calling [handle_actor_creation]. The statement owns the
+            // reference the new actor starts with.
             std::string actor_id_reg = gen_state.reg_label_gen.new_temp_reg();
             gen_state.out_stream << "%" << actor_id_reg << " = call i64 @handle_actor_creation(ptr "
-            << "%" << actor_struct_ptr << ")" << std::endl;
+            << "%" << actor_struct_ptr << ", ptr @" << llvm_name_of_actor_descriptor(actor_construction.actor_name) 
+            << ")" << std::endl;
+            own_actor_refs(gen_state, std::make_shared<LLVMTypeInfo>("i64"), actor_id_reg);
 
             // 3. Compile all the parameters and call the function
             std::vector<std::pair<std::string, std::string>> func_args;
@@ -230,11 +381,11 @@ std::pair<std::string, ValueCategory> emit_valexpr(
                 func_args.push_back({llvm_type, arg_expr_rval_reg});
             }
             func_args.push_back({"i64", actor_id_reg});
+            func_args.push_back({"ptr", actor_struct_ptr});
             // Adding the current passed-in actor to the end for suspension behaviour
             func_args.push_back({"i64", SYNCHRONOUS_ACTOR_ID_REG});
-            std::string constr_func_name_llvm = 
-                llvm_name_of_constructor(actor_construction.constructor_name, actor_construction.actor_name);
-            gen_state.out_stream << "call void @" << constr_func_name_llvm << "(";
+            gen_state.out_stream << "call " << llvm_calling_convention(gen_state, constr_func_name_llvm) 
+            << "void @" << constr_func_name_llvm << "(";
             map_emit_list<std::pair<std::string, std::string>>(
                 gen_state.out_stream,
                 func_args,
@@ -252,6 +403,10 @@ std::pair<std::string, ValueCategory> emit_valexpr(
             // There really is no need to create an RValue, because we can afford to
             // modify the variable in-place (the variable will not be used until it is
             // assigned again)
+            auto ssa_value = gen_state.ssa_var_values.find(unalias.var_name);
+            if(ssa_value != gen_state.ssa_var_values.end()) {
+                return make_pair(ssa_value->second, ValueCategory::RVALUE);
+            }
             return make_pair(
                 gen_state.var_reg_mapping.at(unalias.var_name),
                 ValueCategory::LVALUE);
@@ -276,6 +431,7 @@ std::pair<std::string, ValueCategory> emit_valexpr(
             std::string deref_lval_reg = gen_state.reg_label_gen.new_temp_reg();
             gen_state.out_stream << "%" << deref_lval_reg << " = getelementptr " << deref_type
             <<  ", ptr " << "%" << pointer_reg_rval << ", i64 " << "%" << index_i64 << std::endl;
+            gen_state.pointer_memory_kinds.emplace(deref_lval_reg, MemoryKind::ARRAY_ELEMENT);
 
             return make_pair(deref_lval_reg, ValueCategory::LVALUE);
         },
@@ -298,6 +454,11 @@ std::pair<std::string, ValueCategory> emit_valexpr(
                     gen_state.out_stream << "%" + field_ptr_reg << " = getelementptr " <<
                     llvm_struct_type_name << ", ptr " << "%" + base_struct_reg << ", i32 0, i32 "
                     << std::to_string(field_ind) << std::endl;
+                    // A field lies in the same kind of memory as the struct holding it
+                    auto base_memory_kind = gen_state.pointer_memory_kinds.find(base_struct_reg);
+                    if(base_memory_kind != gen_state.pointer_memory_kinds.end()) {
+                        gen_state.pointer_memory_kinds.emplace(field_ptr_reg, base_memory_kind->second);
+                    }
                     return std::make_pair(field_ptr_reg, ValueCategory::LVALUE);
                 }
                 case(ValueCategory::RVALUE):
@@ -313,8 +474,16 @@ std::pair<std::string, ValueCategory> emit_valexpr(
         },
         [&](const ValExpr::Assignment& assignment) {
             // 1. Compile lhs and rhs and convert rhs to an rvalue
-            std::string llvm_type = 
-                llvm_type_of_coh_type(gen_state, val_expr->expr_type)->llvm_type_name;
+            std::shared_ptr<LLVMTypeInfo> llvm_type_info = llvm_type_of_coh_type(gen_state, val_expr->expr_type);
+            std::string llvm_type = llvm_type_info->llvm_type_name;
+            // A variable in an SSA register just takes the new value. It holds no actor references.
+            const ValExpr::VVar* lhs_var = std::get_if<ValExpr::VVar>(&assignment.lhs->t);
+            if(lhs_var != nullptr && gen_state.ssa_var_values.contains(lhs_var->name)) {
+                std::string rhs_reg_rval = emit_valexpr_rvalue(gen_state, assignment.rhs);
+                std::string prev_val = gen_state.ssa_var_values.at(lhs_var->name);
+                gen_state.ssa_var_values.at(lhs_var->name) = rhs_reg_rval;
+                return make_pair(prev_val, ValueCategory::RVALUE);
+            }
             auto [lhs_reg, lhs_val_cat] = emit_valexpr(gen_state, assignment.lhs);
             assert(lhs_val_cat == ValueCategory::LVALUE);
             auto [rhs_reg, rhs_val_cat] = emit_valexpr(gen_state, assignment.rhs);
@@ -324,13 +493,16 @@ std::pair<std::string, ValueCategory> emit_valexpr(
             std::string prev_val = gen_state.reg_label_gen.new_temp_reg();
             // %<prev_val> = load <llvm_type>, ptr %<lhs_reg>
             gen_state.out_stream << "%" + prev_val << " = load " << llvm_type << ", ptr " <<
-            "%" + lhs_reg << std::endl;
+            "%" + lhs_reg << tbaa_annotation(gen_state, llvm_type, lhs_reg) << std::endl;
 
             // 3. Store the rhs value to [lhs_reg]
             // store <llvm_type> %rhs, ptr %lhs
+            emit_actor_ref_update(gen_state, "actor_retain", llvm_type_info, rhs_reg_rval);
             gen_state.out_stream << "store " << llvm_type << " " << "%" + rhs_reg_rval 
-            << ", ptr " << "%" + lhs_reg << std::endl;  
+            << ", ptr " << "%" + lhs_reg << tbaa_annotation(gen_state, llvm_type, lhs_reg) << std::endl;
             
+            // The reference the location held now belongs to the result
+            own_actor_refs(gen_state, llvm_type_info, prev_val);
             return make_pair(prev_val, ValueCategory::RVALUE);
         },
         [&](const ValExpr::FuncCall& func_call) {
@@ -344,16 +516,18 @@ std::pair<std::string, ValueCategory> emit_valexpr(
                 func_args.push_back({llvm_type, arg_expr_rval_reg});
             }
             func_args.push_back({"i64", THIS_ACTOR_ID_REG});
+            func_args.push_back({"ptr", THIS_ACTOR_STRUCT_REG});
             func_args.push_back({"i64", SYNCHRONOUS_ACTOR_ID_REG});
             
             auto llvm_func_opt = gen_state.func_llvm_name_map.get_value(func_call.func);
             assert(llvm_func_opt != std::nullopt);
             std::string llvm_func = *llvm_func_opt;
             std::string func_return_reg = gen_state.reg_label_gen.new_temp_reg();
-            std::string llvm_return_type = 
-                llvm_type_of_coh_type(gen_state, val_expr->expr_type)->llvm_type_name;
-            gen_state.out_stream << "%" + func_return_reg << " = " <<
-            "call " + llvm_return_type + " @" << llvm_func << "(";
+            std::shared_ptr<LLVMTypeInfo> llvm_return_type_info = 
+                llvm_type_of_coh_type(gen_state, val_expr->expr_type);
+            std::string llvm_return_type = llvm_return_type_info->llvm_type_name;
+            gen_state.out_stream << "%" + func_return_reg << " = " << "call " 
+            << llvm_calling_convention(gen_state, llvm_func) << llvm_return_type << " @" << llvm_func << "(";
             map_emit_list<std::pair<std::string, std::string>>(
                 gen_state.out_stream,
                 func_args,
@@ -363,6 +537,8 @@ std::pair<std::string, ValueCategory> emit_valexpr(
                 }
             );
             gen_state.out_stream << ")" << std::endl;
+            // Callables return actor references retained
+            own_actor_refs(gen_state, llvm_return_type_info, func_return_reg);
             return make_pair(func_return_reg, ValueCategory::RVALUE);
         },
         [&](const ValExpr::BinOpExpr& bin_op_expr) {
@@ -431,30 +607,119 @@ void emit_statement_codegen_list(GenState& gen_state, const std::vector<std::sha
 }
 
 
+// Stores [value_reg] to [location_reg], moving the actor references it holds from the old value
+// to the new one
+void emit_counted_store(
+    GenState& gen_state,
+    std::shared_ptr<LLVMTypeInfo> llvm_type,
+    const std::string& value_reg,
+    const std::string& location_reg) {
+    std::string old_val_reg;
+    if(llvm_type_holds_actors(llvm_type)) {
+        emit_actor_ref_update(gen_state, "actor_retain", llvm_type, value_reg);
+        old_val_reg = gen_state.reg_label_gen.new_temp_reg();
+        gen_state.out_stream << "%" + old_val_reg << " = load " << llvm_type->llvm_type_name << ", ptr "
+        << "%" + location_reg << tbaa_annotation(gen_state, llvm_type->llvm_type_name, location_reg) << std::endl;
+    }
+    // store <llvm_type> %<value_reg>, ptr %<location_reg>
+    gen_state.out_stream << "store " << llvm_type->llvm_type_name << " " << "%" + value_reg << ", ptr " 
+    << "%" + location_reg << tbaa_annotation(gen_state, llvm_type->llvm_type_name, location_reg) << std::endl;
+    if(!old_val_reg.empty()) {
+        emit_actor_ref_update(gen_state, "actor_release", llvm_type, old_val_reg);
+    }
+}
+
+// The SSA variables that [stmt] declares or assigns
+std::set<std::string> collect_assigned_ssa_vars(GenState& gen_state, std::shared_ptr<Stmt> stmt) {
+    std::set<std::string> assigned_vars;
+    std::function<void(std::shared_ptr<ValExpr>)> valexpr_action;
+    valexpr_action = [&](std::shared_ptr<ValExpr> val_expr) {
+        std::visit(Overload{
+            [&](const ValExpr::Assignment& assignment) {
+                const ValExpr::VVar* lhs_var = std::get_if<ValExpr::VVar>(&assignment.lhs->t);
+                if(lhs_var != nullptr && gen_state.ssa_var_values.contains(lhs_var->name)) {
+                    assigned_vars.insert(lhs_var->name);
+                }
+            },
+            [&](const auto&){}
+        }, val_expr->t);
+        visitor_valexpr_walker(val_expr, valexpr_action);
+    };
+    std::function<void(std::shared_ptr<Stmt>)> stmt_action;
+    stmt_action = [&](std::shared_ptr<Stmt> stmt) {
+        std::visit(Overload{
+            [&](const Stmt::VarDeclWithInit& var_decl_init) {
+                if(gen_state.ssa_var_values.contains(var_decl_init.name)) {
+                    assigned_vars.insert(var_decl_init.name);
+                }
+            },
+            [&](const auto&){}
+        }, stmt->t);
+        valexpr_and_stmt_visitors_stmt_walker(stmt, valexpr_action, stmt_action);
+    };
+    stmt_action(stmt);
+    return assigned_vars;
+}
+
+// Emitted at the start of the block joining the end of the then-branch, where the SSA variables
+// held [then_ssa_values], and the end of the else-branch, where they hold [gen_state.ssa_var_values].
+// Adds a phi for each variable the branches disagree on.
+void emit_ssa_join(
+    GenState& gen_state,
+    const std::map<std::string, std::string>& then_ssa_values,
+    const std::string& then_end_block,
+    const std::string& else_end_block) {
+    for(auto &[var, value_reg]: gen_state.ssa_var_values) {
+        const std::string& then_value_reg = then_ssa_values.at(var);
+        if(then_value_reg == value_reg) {
+            continue;
+        }
+        std::string phi_reg = gen_state.reg_label_gen.new_temp_reg();
+        // %<phi_reg> = phi <llvm_type> [ %<then_value>, %<then_end> ], [ %<else_value>, %<else_end> ]
+        gen_state.out_stream << "%" + phi_reg << " = phi " << gen_state.ssa_var_types.at(var) << " [ " 
+        << "%" + then_value_reg << ", %" + then_end_block << " ], [ " << "%" + value_reg << ", %" 
+        + else_end_block << " ]" << std::endl;
+        value_reg = phi_reg;
+    }
+}
+
 void emit_statement_codegen(GenState& gen_state, std::shared_ptr<Stmt> stmt) {
+    size_t first_owned_ref = gen_state.owned_actor_refs.size();
     std::visit(Overload{
         [&](const Stmt::VarDeclWithInit& var_decl_with_init) {
+            auto ssa_value = gen_state.ssa_var_values.find(var_decl_with_init.name);
+            if(ssa_value != gen_state.ssa_var_values.end()) {
+                ssa_value->second = emit_valexpr_rvalue(gen_state, var_decl_with_init.init);
+                return;
+            }
             // We have already allocated memory at the start of the function. Just need to assign it
+            // (the slot may still hold the value from a previous loop iteration)
             assert(gen_state.var_reg_mapping.find(var_decl_with_init.name) != gen_state.var_reg_mapping.end());
-            std::string var_type = llvm_type_of_coh_type(gen_state, var_decl_with_init.init->expr_type)->llvm_type_name;
+            std::shared_ptr<LLVMTypeInfo> var_type = 
+                llvm_type_of_coh_type(gen_state, var_decl_with_init.init->expr_type);
             std::string stack_reg = gen_state.var_reg_mapping.at(var_decl_with_init.name);
             std::string init_reg = emit_valexpr_rvalue(gen_state, var_decl_with_init.init);
-            // store <llvm_type> %<init_reg>, ptr %<stack_reg>
-            gen_state.out_stream << "store " << var_type << " " << "%" << init_reg << ", ptr " << "%" 
-            << stack_reg << std::endl;
+            emit_counted_store(gen_state, var_type, init_reg, stack_reg);
         },
         [&](const Stmt::MemberInitialize& member_init) {
             // The same as [same as assigning to a variable]
             std::string init_val_reg = emit_valexpr_rvalue(gen_state, member_init.init);
             assert(gen_state.var_reg_mapping.find(member_init.member_name) != gen_state.var_reg_mapping.end());
             std::string member_reg = gen_state.var_reg_mapping.at(member_init.member_name);
-            std::string init_type = llvm_type_of_coh_type(gen_state, member_init.init->expr_type)->llvm_type_name;
-            gen_state.out_stream << "store " << init_type << " " << "%" << init_val_reg << ", ptr " 
-            << "%" + member_reg << std::endl;
+            std::shared_ptr<LLVMTypeInfo> init_type = llvm_type_of_coh_type(gen_state, member_init.init->expr_type);
+            emit_counted_store(gen_state, init_type, init_val_reg, member_reg);
         },
         [&](const Stmt::BehaviourCall& be_call) {
-            // Compiling the actor
+            // Compiling the actor (the array of receivers for a broadcast)
             std::string actor_id_reg = emit_valexpr_rvalue(gen_state, be_call.actor);
+            std::shared_ptr<const Type> receiver_type = be_call.actor->expr_type;
+            std::string count_reg;
+            if(be_call.broadcast_count != nullptr) {
+                receiver_type = std::get<Type::Pointer>(receiver_type->t).base_type;
+                // A negative count sends to no receiver
+                std::string count_i32_reg = emit_valexpr_rvalue(gen_state, be_call.broadcast_count);
+                count_reg = convert_count_to_i64(gen_state, count_i32_reg);
+            }
             // Need to package all of these arguments into a struct.
             // Each behaviour has an associated struct. The info of the struct is everywhere, but it is not really
             // needed. The last two parameters of the struct are the actor_id and the actor_struct_pointer
@@ -462,38 +727,89 @@ void emit_statement_codegen(GenState& gen_state, std::shared_ptr<Stmt> stmt) {
             // // %struct_pointer = call ptr @get_instance_struct(i64 %<actor_id_reg>)
             // gen_state.out_stream << "%" + actor_struct_pointer_reg << " = call ptr @get_instance_struct(i64 " 
             // << "%" + actor_id_reg << ")" << std::endl;
-            std::string be_actor_name = actor_name_of_coh_type(be_call.actor->expr_type);
-            std::string be_name_llvm = llvm_name_of_behaviour(be_call.behaviour_name, be_actor_name);
+            std::string be_actor_name = actor_name_of_coh_type(receiver_type);
+            // The receiver's dispatch function picks the behaviour by its index
+            uint32_t be_index = 
+                gen_state.plan->behaviour_indices.at(llvm_name_of_behaviour(be_call.behaviour_name, be_actor_name));
             std::string be_struct_name = llvm_struct_of_behaviour(be_call.behaviour_name, be_actor_name);
-            // Allocating memory for the struct
-            // Getting the size of the struct
-            std::string struct_size = get_llvm_type_size(gen_state, "%" + be_struct_name);
-            // %<struct_ptr> = call ptr @malloc(i64 %<struct_size>)
-            std::string msg_struct_ptr = gen_state.reg_label_gen.new_temp_reg();
-            gen_state.out_stream << "%" + msg_struct_ptr << " = call ptr @malloc(i64 " << "%" + struct_size <<
-            ")" << std::endl;
+            // The arguments are placed in the message in layout order, followed by the receiver id
+            const std::vector<size_t>& arg_field_indices = gen_state.message_field_indices.at(be_struct_name);
             // Compiling all of the behaviour arguments
             std::vector<std::pair<std::string, std::string>> compiler_args_info;
+            std::vector<std::shared_ptr<LLVMTypeInfo>> message_fields(be_call.args.size() + 1);
             for(size_t i = 0; i < be_call.args.size(); i++) {
                 std::string arg_reg = emit_valexpr_rvalue(gen_state, be_call.args[i]);
-                std::string arg_llvm_type = llvm_type_of_coh_type(gen_state, be_call.args[i]->expr_type)->llvm_type_name;
-                compiler_args_info.push_back({arg_llvm_type, arg_reg});
+                std::shared_ptr<LLVMTypeInfo> arg_llvm_type_info = 
+                    llvm_type_of_coh_type(gen_state, be_call.args[i]->expr_type);
+                // The message holds a reference, released when the behaviour finishes. A broadcast
+                // message is copied once per receiver.
+                if(be_call.broadcast_count != nullptr) {
+                    emit_actor_ref_update(gen_state, "actor_retain_many", arg_llvm_type_info, arg_reg, count_reg);
+                }
+                else {
+                    emit_actor_ref_update(gen_state, "actor_retain", arg_llvm_type_info, arg_reg);
+                }
+                compiler_args_info.push_back({arg_llvm_type_info->llvm_type_name, arg_reg});
+                message_fields[arg_field_indices[i]] = arg_llvm_type_info;
+            }
+            // The runtime fills in the receiver of each copy of a broadcast message
+            if(be_call.broadcast_count == nullptr) {
+                compiler_args_info.push_back({"i64", actor_id_reg});
+            }
+            message_fields.back() = std::make_shared<LLVMTypeInfo>("i64");
+            std::string delay_reg;
+            if(be_call.delay_ms != nullptr) {
+                delay_reg = emit_valexpr_rvalue(gen_state, be_call.delay_ms);
+            }
+            // Small messages sent right away are written into the receiver's mailbox entry (see
+            // [reserve_inline_message]), the rest are allocated
+            bool inline_message = be_call.delay_ms == nullptr && be_call.broadcast_count == nullptr
+                && llvm_struct_layout(message_fields).first <= INLINE_MESSAGE_SIZE;
+            std::string msg_struct_ptr = gen_state.reg_label_gen.new_temp_reg();
+            std::string struct_size;
+            if(inline_message) {
+                // %<struct_ptr> = call ptr @reserve_inline_message(i64 %<actor_id_reg>, i32 <be_index>)
+                gen_state.out_stream << "%" + msg_struct_ptr << " = call ptr @reserve_inline_message(i64 " 
+                << "%" + actor_id_reg << ", i32 " << be_index << ")" << std::endl;
+            }
+            else {
+                struct_size = get_llvm_type_size(gen_state, "%" + be_struct_name);
+                // %<struct_ptr> = call ptr @coh_alloc(i64 %<struct_size>)
+                gen_state.out_stream << "%" + msg_struct_ptr << " = call ptr @coh_alloc(i64 " << "%" + struct_size 
+                << ")" << std::endl;
             }
-            compiler_args_info.push_back({"i64", actor_id_reg});
             // Now need to fill out the struct
             for(size_t i = 0; i < compiler_args_info.size(); i++) {
                 auto &[llvm_type, llvm_reg] = compiler_args_info[i];
+                size_t field_ind = i < be_call.args.size() ? arg_field_indices[i] : be_call.args.size();
                 std::string field_ptr = gen_state.reg_label_gen.new_temp_reg();
-                // %<field_ptr> = getelementptr %<BeStruct>, ptr %<StructObj>, i32 0, i32 i
+                // %<field_ptr> = getelementptr %<BeStruct>, ptr %<StructObj>, i32 0, i32 <field_ind>
                 gen_state.out_stream << "%" + field_ptr << " = getelementptr " << "%" + be_struct_name << ", ptr "
-                << "%" + msg_struct_ptr << ", i32 0, i32 " << i << std::endl;
+                << "%" + msg_struct_ptr << ", i32 0, i32 " << field_ind << std::endl;
+                gen_state.pointer_memory_kinds.emplace(field_ptr, MemoryKind::MESSAGE_FIELD);
                 // store <llvm_type> %<llvm_reg>, ptr %<field_ptr>
                 gen_state.out_stream << "store " << llvm_type << " " << "%" + llvm_reg << ", ptr " 
-                << "%" + field_ptr << std::endl;
+                << "%" + field_ptr << tbaa_annotation(gen_state, llvm_type, field_ptr) << std::endl;
+            }
+            // Now, pass this struct to [handle_behaviour_call] (or [handle_delayed_behaviour_call], 
+            // [handle_broadcast_behaviour_call]). An inline message has already been sent.
+            if(inline_message) {
+                return;
+            }
+            if(be_call.broadcast_count != nullptr) {
+                gen_state.out_stream << "call void @handle_broadcast_behaviour_call(ptr " << "%" + actor_id_reg
+                << ", i64 " << "%" + count_reg << ", ptr " << "%" + msg_struct_ptr << ", i64 " 
+                << "%" + struct_size << ", i32 " << be_index << ")" << std::endl;
+            }
+            else if(be_call.delay_ms != nullptr) {
+                gen_state.out_stream << "call void @handle_delayed_behaviour_call(i64 " << "%" + actor_id_reg 
+                << ", ptr " << "%" + msg_struct_ptr << ", i32 " << be_index << ", i32 " << "%" + delay_reg 
+                << ")" << std::endl;
+            }
+            else {
+                gen_state.out_stream << "call void @handle_behaviour_call(i64 " << "%" + actor_id_reg << ", ptr " 
+                << "%" + msg_struct_ptr << ", i32 " << be_index << ")" << std::endl;
             }
-            // Now, pass this struct to [handle_behaviour_call]
-            gen_state.out_stream << "call void @handle_behaviour_call(i64 " << "%" + actor_id_reg << ", ptr " 
-            << "%" + msg_struct_ptr << ", ptr @" << be_name_llvm << ")" << std::endl;
         },
         [&](const Stmt::Print& print_expr) {
             std::string print_int_reg = emit_valexpr_rvalue(gen_state, print_expr.print_expr);
@@ -515,38 +831,94 @@ void emit_statement_codegen(GenState& gen_state, std::shared_ptr<Stmt> stmt) {
         [&](const Stmt::If& if_stmt) {
             // Compiling the condition
             std::string cond_reg = emit_valexpr_rvalue(gen_state, if_stmt.cond);
+            release_owned_actor_refs(gen_state, first_owned_ref);
             std::string then_label = gen_state.reg_label_gen.new_label();
             std::string else_label = gen_state.reg_label_gen.new_label();
             std::string end_label = gen_state.reg_label_gen.new_label();
             // br i1 %<cond_reg>, label %<then_label>, label %<else_label>
             gen_state.out_stream << "br i1 " << "%" + cond_reg << ", label " << "%" + then_label << ", "
             << "label " << "%" + else_label << std::endl;
-            gen_state.out_stream << then_label << ":" << std::endl;
+            std::map<std::string, std::string> cond_ssa_values = gen_state.ssa_var_values;
+            emit_label(gen_state, then_label);
             // Compiling the if-block
             emit_statement_codegen_list(gen_state, if_stmt.then_body);
             branch_label(gen_state, end_label);
+            std::string then_end_block = gen_state.curr_block;
+            std::map<std::string, std::string> then_ssa_values = std::move(gen_state.ssa_var_values);
             // Compiling the else-block
-            gen_state.out_stream << else_label << ":" << std::endl;
+            gen_state.ssa_var_values = std::move(cond_ssa_values);
+            emit_label(gen_state, else_label);
             if(if_stmt.else_body != std::nullopt) {
                 emit_statement_codegen_list(gen_state, *if_stmt.else_body);
             }
             branch_label(gen_state, end_label);
-            gen_state.out_stream << end_label << ":" << std::endl;
+            std::string else_end_block = gen_state.curr_block;
+            emit_label(gen_state, end_label);
+            emit_ssa_join(gen_state, then_ssa_values, then_end_block, else_end_block);
         },
         [&](const Stmt::While& while_stmt) {
             std::string cond_label = gen_state.reg_label_gen.new_label();
             std::string body_label = gen_state.reg_label_gen.new_label();
             std::string end_label = gen_state.reg_label_gen.new_label();
+            // The SSA variables the loop assigns get a phi in the condition block. Its incoming
+            // blocks are a preheader and a latch, as the blocks the condition and the body end in
+            // are only known once they are emitted.
+            /*
+            br label %preheader
+
+            preheader:
+            br label %cond
+
+            cond:
+            %x = phi T [ %x.before, %preheader ], [ %x.next, %latch ]
+            ...
+
+            latch:
+            %x.next = bitcast T %x.after_body to T
+            br label %cond
+            */
+            std::set<std::string> loop_vars = collect_assigned_ssa_vars(gen_state, stmt);
+            std::string preheader_label;
+            std::string latch_label;
+            std::map<std::string, std::string> latch_regs;
+            if(!loop_vars.empty()) {
+                preheader_label = gen_state.reg_label_gen.new_label();
+                latch_label = gen_state.reg_label_gen.new_label();
+                branch_label(gen_state, preheader_label);
+                emit_label(gen_state, preheader_label);
+            }
             branch_label(gen_state, cond_label);
-            gen_state.out_stream << cond_label << ":" << std::endl;
+            emit_label(gen_state, cond_label);
+            for(const std::string& var: loop_vars) {
+                std::string phi_reg = gen_state.reg_label_gen.new_temp_reg();
+                std::string latch_reg = gen_state.reg_label_gen.new_temp_reg();
+                std::string& value_reg = gen_state.ssa_var_values.at(var);
+                gen_state.out_stream << "%" + phi_reg << " = phi " << gen_state.ssa_var_types.at(var) << " [ "
+                << "%" + value_reg << ", %" + preheader_label << " ], [ " << "%" + latch_reg << ", %" 
+                + latch_label << " ]" << std::endl;
+                value_reg = phi_reg;
+                latch_regs.emplace(var, latch_reg);
+            }
             std::string cond_reg = emit_valexpr_rvalue(gen_state, while_stmt.cond);
+            release_owned_actor_refs(gen_state, first_owned_ref);
             // br i1 %<cond_reg>, label %<body_label>, label %<end_label>
             gen_state.out_stream << "br i1 " << "%" + cond_reg << ", label " << "%" + body_label << ", label "
             << "%" + end_label << std::endl;
-            gen_state.out_stream << body_label << ":" << std::endl;
+            std::map<std::string, std::string> exit_ssa_values = gen_state.ssa_var_values;
+            emit_label(gen_state, body_label);
             emit_statement_codegen_list(gen_state, while_stmt.body);
+            if(!loop_vars.empty()) {
+                branch_label(gen_state, latch_label);
+                emit_label(gen_state, latch_label);
+                for(const auto& [var, latch_reg]: latch_regs) {
+                    const std::string& llvm_type = gen_state.ssa_var_types.at(var);
+                    gen_state.out_stream << "%" + latch_reg << " = bitcast " << llvm_type << " " 
+                    << "%" + gen_state.ssa_var_values.at(var) << " to " << llvm_type << std::endl;
+                }
+            }
             branch_label(gen_state, cond_label);
-            gen_state.out_stream << end_label << ":" << std::endl;
+            emit_label(gen_state, end_label);
+            gen_state.ssa_var_values = std::move(exit_ssa_values);
         },
         [&](std::shared_ptr<Stmt::Atomic> atomic_stmt) {
             if(gen_state.locks_acquired.size() != 0) {
@@ -556,9 +928,6 @@ void emit_statement_codegen(GenState& gen_state, std::shared_ptr<Stmt> stmt) {
             }
             gen_state.locks_acquired.reserve(atomic_stmt->locks_dereferenced->size());
             for(const std::string& lock: *(atomic_stmt->locks_dereferenced)) {
-                if(gen_state.lock_id_map.find(lock) == gen_state.lock_id_map.end()) {
-                    gen_state.lock_id_map.emplace(lock, gen_state.lock_id_map.size());
-                }
                 assert(gen_state.lock_id_map.find(lock) != gen_state.lock_id_map.end());
                 uint64_t lock_id = gen_state.lock_id_map.at(lock);
                 gen_state.locks_acquired.push_back(lock_id);
@@ -578,27 +947,36 @@ void emit_statement_codegen(GenState& gen_state, std::shared_ptr<Stmt> stmt) {
         },
         [&](const Stmt::Return& return_stmt) {
             std::string return_expr_reg = emit_valexpr_rvalue(gen_state, return_stmt.expr);
-            std::string llvm_return_type = llvm_type_of_coh_type(gen_state, return_stmt.expr->expr_type)->llvm_type_name;
+            std::shared_ptr<LLVMTypeInfo> llvm_return_type_info = 
+                llvm_type_of_coh_type(gen_state, return_stmt.expr->expr_type);
+            std::string llvm_return_type = llvm_return_type_info->llvm_type_name;
+            // The caller owns the returned references. Retain them before the locals they may
+            // have been read from are released.
+            emit_actor_ref_update(gen_state, "actor_retain", llvm_return_type_info, return_expr_reg);
+            release_owned_actor_refs(gen_state, first_owned_ref);
+            release_actor_ref_slots(gen_state);
+            end_frame_array_lifetimes(gen_state);
             // Need to release any locks held
             for(uint64_t lock_id: gen_state.locks_acquired) {
                 gen_state.out_stream << "call void @handle_unlock(i64 " << lock_id << ")" << std::endl;
             }
             gen_state.out_stream << "ret " << llvm_return_type << " " << "%" + return_expr_reg << std::endl;
+            // Whatever follows is unreachable, but may still branch to a block with phis, which
+            // have to name it
+            emit_label(gen_state, gen_state.reg_label_gen.new_label());
         }
     }, stmt->t);
+    release_owned_actor_refs(gen_state, first_owned_ref);
 }
 
 void compile_callable_body(
     GenState &gen_state, 
     std::vector<std::shared_ptr<Stmt>> callable_body) {
     if(gen_state.curr_actor) {
-        // Get the structure corresponding to the body of the current actor and unpack it on the stack
+        // The members of the current actor are addressed through the struct passed in by the caller
+        // (or the runtime, for behaviours)
         std::string curr_actor_llvm_struct = llvm_struct_of_actor(gen_state.curr_actor->name);
         std::string curr_actor_name = gen_state.curr_actor->name;
-        // Getting the struct member from the runtime
-        std::string actor_struct_reg = gen_state.reg_label_gen.new_temp_reg();
-        gen_state.out_stream << "%" + actor_struct_reg << " = call ptr @get_instance_struct(i64 "
-        << "%" + THIS_ACTOR_ID_REG << ")" << std::endl;
         assert(gen_state.type_name_info_map.find(curr_actor_name) != gen_state.type_name_info_map.end());
         std::shared_ptr<LLVMStructInfo> actor_struct_info = 
             gen_state.type_name_info_map.at(curr_actor_name)->struct_info;
@@ -606,41 +984,68 @@ void compile_callable_body(
         for(const auto&[mem_name, mem_info]: actor_struct_info->field_ind_map) {
             std::string mem_ptr_reg = gen_state.reg_label_gen.new_temp_reg();
             gen_state.out_stream << "%" + mem_ptr_reg << " = getelementptr " << "%" + curr_actor_llvm_struct << 
-            ", ptr " << "%" + actor_struct_reg << ", i32 0, i32 " << mem_info.field_index << std::endl;
+            ", ptr " << "%" + THIS_ACTOR_STRUCT_REG << ", i32 0, i32 " << mem_info.field_index << std::endl;
             assert(gen_state.var_reg_mapping.find(mem_name) == gen_state.var_reg_mapping.end());
             gen_state.var_reg_mapping.emplace(mem_name, mem_ptr_reg);
+            gen_state.pointer_memory_kinds.emplace(mem_ptr_reg, MemoryKind::ACTOR_MEMBER);
         }
     }
 
+    allocate_suspend_tag(gen_state);
     std::unordered_map<std::string, std::shared_ptr<const Type>> local_vars = 
         collect_local_variable_types(callable_body);
     for(const auto& [var, full_type]: local_vars) {
-        allocate_var_to_stack(
-            gen_state, 
-            llvm_type_of_coh_type(gen_state, full_type)->llvm_type_name,
-            var);
+        std::shared_ptr<LLVMTypeInfo> llvm_type = llvm_type_of_coh_type(gen_state, full_type);
+        if(gen_state.ssa_locals && is_ssa_local_type(llvm_type)) {
+            // Zero until the declaration runs, which gives the phis of loops a value to start from
+            std::string init_reg = gen_state.reg_label_gen.new_temp_reg();
+            gen_state.out_stream << "%" + init_reg << " = bitcast " << llvm_type->llvm_type_name 
+            << " zeroinitializer to " << llvm_type->llvm_type_name << std::endl;
+            gen_state.ssa_var_types.emplace(var, llvm_type->llvm_type_name);
+            gen_state.ssa_var_values.emplace(var, init_reg);
+            continue;
+        }
+        allocate_var_to_stack(gen_state, llvm_type->llvm_type_name, var);
+        if(llvm_type_holds_actors(llvm_type)) {
+            // Zeroed, as the declaration may not run before the callable exits
+            std::string stack_reg = gen_state.var_reg_mapping.at(var);
+            gen_state.out_stream << "store " << llvm_type->llvm_type_name << " zeroinitializer, ptr "
+            << "%" + stack_reg << std::endl;
+            gen_state.actor_ref_slots.push_back({stack_reg, llvm_type});
+        }
     }
+    allocate_frame_arrays(gen_state, callable_body);
 
     // Now everything is set up properly. Can proceed with the generation of statements
     emit_statement_codegen_list(gen_state, callable_body);
 }
 
-void compile_synchronous_callable(
-    GenState& gen_state, 
-    const std::string& llvm_func_name,
-    const std::string& llvm_return_type,
-    std::vector<TopLevelItem::VarDecl>& params,
-    std::vector<std::shared_ptr<Stmt>>& callable_body) {
-    // Pairs of {<llvm_type>, <var/reg_name>}
+// Parameters of a function or constructor, followed by the hidden ones every synchronous callable
+// takes. Pairs of {<llvm_type>, <var/reg_name>}
+std::vector<std::pair<std::string, std::string>> synchronous_callable_params(
+    GenState& gen_state,
+    const std::vector<TopLevelItem::VarDecl>& params) {
     std::vector<std::pair<std::string, std::string>> callable_params;
-    for(TopLevelItem::VarDecl &var_decl: params) {
+    for(const TopLevelItem::VarDecl &var_decl: params) {
         callable_params.push_back({
             llvm_type_of_coh_type(gen_state, var_decl.type)->llvm_type_name,
             var_decl.name
         });
     }
     callable_params.push_back({"i64", THIS_ACTOR_ID_REG});
+    callable_params.push_back({"ptr", THIS_ACTOR_STRUCT_REG});
     callable_params.push_back({"i64", SYNCHRONOUS_ACTOR_ID_REG});
+    return callable_params;
+}
+
+void compile_synchronous_callable(
+    GenState& gen_state, 
+    const std::string& llvm_func_name,
+    const std::string& llvm_return_type,
+    std::vector<TopLevelItem::VarDecl>& params,
+    std::vector<std::shared_ptr<Stmt>>& callable_body) {
+    std::vector<std::pair<std::string, std::string>> callable_params = 
+        synchronous_callable_params(gen_state, params);
     map_emit_llvm_function_sig<std::pair<std::string, std::string>>(
         gen_state.out_stream,
         llvm_func_name,
@@ -648,15 +1053,25 @@ void compile_synchronous_callable(
         callable_params,
         [&](const std::pair<std::string, std::string>& var_decl_pair) {
             return var_decl_pair.first + " %" + var_decl_pair.second;
-        }
+        },
+        llvm_callable_linkage(gen_state, llvm_func_name)
     );
-    gen_state.out_stream << " {" << std::endl;
+    gen_state.out_stream << " " << gen_state.plan->callables.at(llvm_func_name).attributes << " {" << std::endl;
 
     // Do not want to copy the hidden parameters on the stack
     callable_params.pop_back();
     callable_params.pop_back();
+    callable_params.pop_back();
 
-    for(auto &var_decl_pair: callable_params) {
+    for(size_t i = 0; i < callable_params.size(); i++) {
+        auto &var_decl_pair = callable_params[i];
+        std::shared_ptr<LLVMTypeInfo> param_type = llvm_type_of_coh_type(gen_state, params[i].type);
+        if(gen_state.ssa_locals && is_ssa_local_type(param_type)) {
+            // The parameter register holds the initial value
+            gen_state.ssa_var_types.emplace(var_decl_pair.second, var_decl_pair.first);
+            gen_state.ssa_var_values.emplace(var_decl_pair.second, var_decl_pair.second);
+            continue;
+        }
         allocate_var_to_stack(gen_state, var_decl_pair.first, var_decl_pair.second);
         // The below code may be a bit confusing, but the idea is simple.
         // The function parameters register names are the same as the variable names
@@ -669,9 +1084,16 @@ void compile_synchronous_callable(
         gen_state.out_stream << "store " << var_decl_pair.first << " " << "%" + var_decl_pair.second 
         << ", " << "ptr " << "%" + stack_reg << std::endl;
         gen_state.var_reg_mapping.emplace(var_decl_pair.second, stack_reg);
+        // The parameter holds its own references until the callable exits
+        if(llvm_type_holds_actors(param_type)) {
+            emit_actor_ref_update(gen_state, "actor_retain", param_type, var_decl_pair.second);
+            gen_state.actor_ref_slots.push_back({stack_reg, param_type});
+        }
     }
     compile_callable_body(gen_state, callable_body);
     if(llvm_return_type == "void") {
+        release_actor_ref_slots(gen_state);
+        end_frame_array_lifetimes(gen_state);
         gen_state.out_stream << "ret void" << std::endl;
     }
     gen_state.out_stream << "unreachable" << std::endl;
@@ -698,40 +1120,48 @@ void emit_constructor(GenState& gen_state, std::shared_ptr<TopLevelItem::Constru
 
 void generate_fake_start_actor(GenState& gen_state) {
     gen_state.refresh_var_reg_info();
-    // Generates a function that will act as a behaviour to be scheduled (we are going to fool the runtime)
-    gen_state.out_stream << "define void @start.runtime(ptr %message) {" << std::endl;
+    // Generates a function that will act as a behaviour to be scheduled (we are going to fool the runtime).
+    // It is the dispatch function of the bootstrap instance, which only ever gets this one message.
+    gen_state.out_stream << "define internal void @start.runtime(ptr %message, ptr %" << THIS_ACTOR_STRUCT_REG 
+    << ", i32 %behaviour) nounwind {" << std::endl;
     // Extract [SYNCHRONOUS_ACTOR_ID_REG] from %message
     gen_state.out_stream << "%" + SYNCHRONOUS_ACTOR_ID_REG << " = load i64, ptr %message" << std::endl;
-    std::string main_struct =  "%Main.struct";
-    std::string main_struct_size = get_llvm_type_size(gen_state, main_struct);
-    std::string main_instance_ptr_reg = gen_state.reg_label_gen.new_temp_reg();
-    gen_state.out_stream << "%" + main_instance_ptr_reg << " = call ptr @malloc(i64 " << "%" + main_struct_size
-    << ")" << std::endl;
+    allocate_suspend_tag(gen_state);
+    std::string main_instance_ptr_reg = allocate_actor_struct(gen_state, "Main");
+    // The reference [Main] starts with is never released: the runtime (and an embedding host)
+    // keep sending to it
     std::string actor_id_reg = gen_state.reg_label_gen.new_temp_reg();
     gen_state.out_stream << "%" + actor_id_reg << " = call i64 @handle_actor_creation(ptr "
-    << "%" << main_instance_ptr_reg << ")" << std::endl;
+    << "%" << main_instance_ptr_reg << ", ptr @" << llvm_name_of_actor_descriptor("Main") << ")" << std::endl;
     // Calling the constructor
-    std::string create_constructor_llvm_name = "create.Main.constr";
-    gen_state.out_stream << "call void @" << create_constructor_llvm_name << "(i64 " << "%" + actor_id_reg << ", "
-    << "i64 " << "%" + SYNCHRONOUS_ACTOR_ID_REG << ")" << std::endl;
+    std::string create_constructor_llvm_name = llvm_name_of_constructor("create", "Main");
+    gen_state.out_stream << "call " << llvm_calling_convention(gen_state, create_constructor_llvm_name) 
+    << "void @" << create_constructor_llvm_name << "(i64 " << "%" + actor_id_reg << ", "
+    << "ptr " << "%" + main_instance_ptr_reg << ", i64 " << "%" + SYNCHRONOUS_ACTOR_ID_REG << ")" << std::endl;
+    gen_state.out_stream << "call void @coh_free(ptr %message)" << std::endl;
     SuspendTag suspend_tag;
     suspend_tag.kind = SuspendTagKind::RETURN;
     generate_suspend_call(gen_state, suspend_tag);
     gen_state.out_stream << "ret void" << std::endl;
     gen_state.out_stream << "}" << std::endl;
+    gen_state.out_stream << "@start.descriptor = internal constant %ActorDescriptor.runtime "
+    << "{ ptr null, ptr @start.runtime, i64 0, ptr null }" << std::endl;
 }
 
 void generate_coherence_initialize(GenState& gen_state) {
     gen_state.refresh_var_reg_info();
-    gen_state.out_stream << "define void @coherence_initialize() {" << std::endl;
+    gen_state.out_stream << "define void @coherence_initialize() nounwind {" << std::endl;
     std::string instance_id_reg = gen_state.reg_label_gen.new_temp_reg();
-    gen_state.out_stream << "%" + instance_id_reg << " = call i64 @handle_actor_creation(ptr null)" << std::endl;
+    gen_state.out_stream << "%" + instance_id_reg << " = call i64 @handle_actor_creation(ptr null, "
+    << "ptr @start.descriptor)" << std::endl;
     // Allocating the message
     std::string message_ptr_reg = gen_state.reg_label_gen.new_temp_reg();
-    gen_state.out_stream << "%" + message_ptr_reg << " = call ptr @malloc(i64 8)" << std::endl;
+    gen_state.out_stream << "%" + message_ptr_reg << " = call ptr @coh_alloc(i64 8)" << std::endl;
     gen_state.out_stream << "store i64 " << "%" + instance_id_reg << ", ptr " << "%" + message_ptr_reg << std::endl;
     gen_state.out_stream << "call void @handle_behaviour_call(i64 " << "%" + instance_id_reg << 
-    ", ptr " << "%" + message_ptr_reg << ", ptr @start.runtime)" << std::endl;
+    ", ptr " << "%" + message_ptr_reg << ", i32 0)" << std::endl;
+    // The bootstrap instance is freed once it has created [Main]
+    gen_state.out_stream << "call void @actor_release(i64 " << "%" + instance_id_reg << ")" << std::endl;
     gen_state.out_stream << "ret void" << std::endl;
     gen_state.out_stream << "}" << std::endl; 
 }
@@ -749,15 +1179,16 @@ void emit_behaviour(GenState& gen_state, std::shared_ptr<TopLevelItem::Behaviour
         });
     }
     // Creating the behaviour function signature
-    // Single parameter [ptr %message]
+    // Parameters [ptr %message, ptr %this.struct], both passed in by the runtime
     map_emit_llvm_function_sig<std::string>(
         gen_state.out_stream,
         be_name_llvm,
         "void",
-        std::vector<std::string>{"ptr %message"},
-        [](const std::string& s) {return s;}
+        std::vector<std::string>{"ptr %message", "ptr %" + THIS_ACTOR_STRUCT_REG},
+        [](const std::string& s) {return s;},
+        llvm_callable_linkage(gen_state, be_name_llvm)
     );
-    gen_state.out_stream << " {" << std::endl;
+    gen_state.out_stream << " " << gen_state.plan->callables.at(be_name_llvm).attributes << " {" << std::endl;
     // Now simply unpack and store all the stuff on the stack
     size_t be_struct_size = struct_mem_vec.size() + 1; // There is the [this] pointer at the end
     size_t last_ind = be_struct_size - 1;
@@ -772,10 +1203,28 @@ void emit_behaviour(GenState& gen_state, std::shared_ptr<TopLevelItem::Behaviour
     for(size_t i = 0; i < struct_mem_vec.size(); i++) {
         std::string param_reg = gen_state.reg_label_gen.new_temp_reg();
         gen_state.out_stream << "%" + param_reg << " = getelementptr " << "%" + be_struct_llvm << ", ptr "
-        << "%message" << ", i32 0, i32 " << i << std::endl;
+        << "%message" << ", i32 0, i32 " << gen_state.message_field_indices.at(be_struct_llvm)[i] << std::endl;
+        gen_state.pointer_memory_kinds.emplace(param_reg, MemoryKind::MESSAGE_FIELD);
+        std::shared_ptr<LLVMTypeInfo> param_type = llvm_type_of_coh_type(gen_state, behaviour_def->params[i].type);
+        if(gen_state.ssa_locals && is_ssa_local_type(param_type)) {
+            std::string value_reg = gen_state.reg_label_gen.new_temp_reg();
+            gen_state.out_stream << "%" + value_reg << " = load " << param_type->llvm_type_name << ", ptr "
+            << "%" + param_reg << tbaa_annotation(gen_state, param_type->llvm_type_name, param_reg) << std::endl;
+            gen_state.ssa_var_types.emplace(struct_mem_vec[i].first, param_type->llvm_type_name);
+            gen_state.ssa_var_values.emplace(struct_mem_vec[i].first, value_reg);
+            continue;
+        }
         gen_state.var_reg_mapping.emplace(struct_mem_vec[i].first, param_reg);
+        // The sender retained the references in the message
+        if(llvm_type_holds_actors(param_type)) {
+            gen_state.actor_ref_slots.push_back({param_reg, param_type});
+        }
     }
     compile_callable_body(gen_state, behaviour_def->body);
+    release_actor_ref_slots(gen_state);
+    end_frame_array_lifetimes(gen_state);
+    // Nothing reads the message anymore
+    gen_state.out_stream << "call void @release_message(ptr %message)" << std::endl;
     // Returning to the runtime
     SuspendTag suspend_tag;
     suspend_tag.kind = SuspendTagKind::RETURN;
@@ -784,30 +1233,396 @@ void emit_behaviour(GenState& gen_state, std::shared_ptr<TopLevelItem::Behaviour
     gen_state.out_stream << "}" << std::endl;
 }
 
+// Emits [<Actor>.drop], which the runtime calls with the actor struct once the actor is
+// unreferenced, to release the references held by its members
+void emit_actor_drop(GenState& gen_state, std::shared_ptr<TopLevelItem::Actor> actor_def) {
+    gen_state.refresh_var_reg_info();
+    std::string actor_struct_llvm = "%" + llvm_struct_of_actor(actor_def->name);
+    std::string drop_name_llvm = llvm_name_of_actor_drop(actor_def->name);
+    gen_state.out_stream << "define " << llvm_callable_linkage(gen_state, drop_name_llvm) << "void @" 
+    << drop_name_llvm << "(ptr %actor) " << gen_state.plan->callables.at(drop_name_llvm).attributes << " {" 
+    << std::endl;
+    std::shared_ptr<LLVMStructInfo> actor_struct_info = 
+        gen_state.type_name_info_map.at(actor_def->name)->struct_info;
+    for(const LLVMStructInfo::FieldInfo& mem_info: actor_struct_info->ind_field_map) {
+        if(!llvm_type_holds_actors(mem_info.field_type)) {
+            continue;
+        }
+        std::string mem_ptr_reg = gen_state.reg_label_gen.new_temp_reg();
+        gen_state.out_stream << "%" + mem_ptr_reg << " = getelementptr " << actor_struct_llvm << 
+        ", ptr %actor, i32 0, i32 " << mem_info.field_index << std::endl;
+        gen_state.actor_ref_slots.push_back({mem_ptr_reg, mem_info.field_type});
+    }
+    release_actor_ref_slots(gen_state);
+    gen_state.out_stream << "ret void" << std::endl;
+    gen_state.out_stream << "}" << std::endl;
+}
+
+/*
+Emits [<Actor>.dispatch], which the runtime calls to run behaviour [%behaviour] of the actor, and
+the [<Actor>.descriptor] it is registered with (see [ActorDescriptor]). The dispatch function
+switches on the index and calls the behaviours directly, which LLVM can then inline:
+    define internal void @<Actor>.dispatch(ptr %message, ptr %actor, i32 %behaviour) {
+        switch i32 %behaviour, label %unknown [ i32 0, label %be.0 ... ]
+    be.0:
+        call void @<be>.<Actor>.be(ptr %message, ptr %actor)
+        ret void
+    ...
+    unknown:
+        unreachable
+    }
+*/
+void emit_actor_dispatch(GenState& gen_state, std::shared_ptr<TopLevelItem::Actor> actor_def) {
+    gen_state.refresh_var_reg_info();
+    std::vector<std::string> behaviours_llvm;
+    for(auto& actor_mem: actor_def->actor_members) {
+        if(auto be_def = std::get_if<std::shared_ptr<TopLevelItem::Behaviour>>(&actor_mem)) {
+            behaviours_llvm.push_back(llvm_name_of_behaviour((*be_def)->name, actor_def->name));
+        }
+    }
+    std::string table_llvm = actor_def->name + ".behaviours";
+    std::string table_type = "[" + std::to_string(behaviours_llvm.size()) + " x ptr]";
+    std::string dispatch_llvm = llvm_name_of_actor_dispatch(actor_def->name);
+    gen_state.out_stream << "define internal void @" << dispatch_llvm 
+    << "(ptr %message, ptr %actor, i32 %behaviour) nounwind {" << std::endl;
+    if(!gen_state.direct_dispatch) {
+        // %<be_ptr> = getelementptr [N x ptr], ptr @<Actor>.behaviours, i32 0, i32 %behaviour
+        std::string be_ptr_reg = gen_state.reg_label_gen.new_temp_reg();
+        gen_state.out_stream << "%" + be_ptr_reg << " = getelementptr " << table_type << ", ptr @" << table_llvm 
+        << ", i32 0, i32 %behaviour" << std::endl;
+        std::string be_fn_reg = gen_state.reg_label_gen.new_temp_reg();
+        gen_state.out_stream << "%" + be_fn_reg << " = load ptr, ptr " << "%" + be_ptr_reg << std::endl;
+        gen_state.out_stream << "call void " << "%" + be_fn_reg << "(ptr %message, ptr %actor)" << std::endl;
+        gen_state.out_stream << "ret void" << std::endl;
+    }
+    else {
+        std::string unknown_label = gen_state.reg_label_gen.new_label();
+        std::vector<std::string> be_labels;
+        for(size_t i = 0; i < behaviours_llvm.size(); i++) {
+            be_labels.push_back(gen_state.reg_label_gen.new_label());
+        }
+        gen_state.out_stream << "switch i32 %behaviour, label " << "%" + unknown_label << " [";
+        for(size_t i = 0; i < behaviours_llvm.size(); i++) {
+            gen_state.out_stream << " i32 " << i << ", label " << "%" + be_labels[i];
+        }
+        gen_state.out_stream << " ]" << std::endl;
+        for(size_t i = 0; i < behaviours_llvm.size(); i++) {
+            emit_label(gen_state, be_labels[i]);
+            gen_state.out_stream << "call void @" << behaviours_llvm[i] << "(ptr %message, ptr %actor)" << std::endl;
+            gen_state.out_stream << "ret void" << std::endl;
+        }
+        // Messages only carry the indices of the receiver's behaviours
+        emit_label(gen_state, unknown_label);
+        gen_state.out_stream << "unreachable" << std::endl;
+    }
+    gen_state.out_stream << "}" << std::endl;
+
+    gen_state.out_stream << "@" << table_llvm << " = internal constant " << table_type << " [";
+    map_emit_list<std::string>(
+        gen_state.out_stream,
+        behaviours_llvm,
+        ", ",
+        [](const std::string& be_llvm) {
+            return "ptr @" + be_llvm;
+        }
+    );
+    gen_state.out_stream << "]" << std::endl;
+    std::string descriptor_llvm = llvm_name_of_actor_descriptor(actor_def->name);
+    gen_state.out_stream << "@" << descriptor_llvm << " = " 
+    << (gen_state.plan->descriptors.at(descriptor_llvm).internal ? "internal " : "") 
+    << "constant %ActorDescriptor.runtime { ptr @" << llvm_name_of_actor_drop(actor_def->name) 
+    << ", ptr @" << dispatch_llvm << ", i64 " << behaviours_llvm.size() << ", ptr @" << table_llvm << " }" 
+    << std::endl;
+}
+
 void generate_declarations(GenState& gen_state) {
     std::string external_decls = R"(
 %SuspendTag.runtime = type <{ i32, i64 }>
+%ActorDescriptor.runtime = type { ptr, ptr, i64, ptr }
 
 declare void @print_int(i32)
-declare ptr @malloc(i64)
+declare ptr @coh_alloc(i64)
+declare void @coh_free(ptr)
+declare ptr @coh_arena_alloc(i64)
+declare ptr @coh_alloc_zeroed(i64)
+declare void @coh_fill_array(ptr, i64, i64)
+declare void @llvm.memset.p0.i64(ptr, i8, i64, i1 immarg)
+declare void @llvm.lifetime.start.p0(i64 immarg, ptr nocapture)
+declare void @llvm.lifetime.end.p0(i64 immarg, ptr nocapture)
 declare void @handle_unlock(i64)
-declare void @handle_behaviour_call(i64, ptr, ptr)
+declare void @handle_behaviour_call(i64, ptr, i32)
+declare void @handle_delayed_behaviour_call(i64, ptr, i32, i32)
+declare void @handle_broadcast_behaviour_call(ptr, i64, ptr, i64, i32)
+declare void @release_message(ptr)
+declare ptr @reserve_inline_message(i64, i32)
 declare ptr @get_instance_struct(i64)
-declare i64 @handle_actor_creation(ptr)
+declare i64 @handle_actor_creation(ptr, ptr)
+declare i64 @handle_bulk_actor_creation(i64, i64, ptr)
+declare void @actor_retain(i64)
+declare void @actor_retain_many(i64, i64)
+declare void @actor_release(i64)
 declare void @suspend_instance(i64, ptr)
 )";
     gen_state.out_stream << external_decls << std::endl;
     
 }
 
-void ast_codegen(Program* program_ast, std::string output_file_name) {
-    std::ofstream out_stream(output_file_name); 
-    GenState gen_state(out_stream);
+// Lock ids follow the order of the lock names, which does not depend on how the program is split
+std::unordered_map<std::string, uint64_t> assign_lock_ids(Program* program_ast) {
+    std::set<std::string> lock_names;
+    auto dummy_valexpr_walker = [&](std::shared_ptr<ValExpr> val_expr) {return;};
+    std::function<void(std::shared_ptr<Stmt>)> stmt_action;
+    stmt_action = [&](std::shared_ptr<Stmt> stmt) {
+        std::visit(Overload{
+            [&](std::shared_ptr<Stmt::Atomic> atomic_stmt) {
+                lock_names.insert(
+                    atomic_stmt->locks_dereferenced->begin(), 
+                    atomic_stmt->locks_dereferenced->end());
+            },
+            [&](const auto&){}
+        }, stmt->t);
+        valexpr_and_stmt_visitors_stmt_walker(stmt, dummy_valexpr_walker, stmt_action);
+    };
+    auto walk_body = [&](const std::vector<std::shared_ptr<Stmt>>& body) {
+        for(auto stmt: body) {
+            stmt_action(stmt);
+        }
+    };
+    for(const TopLevelItem& top_level_item: program_ast->top_level_items) {
+        std::visit(Overload{
+            [&](const TopLevelItem::TypeDef& type_def) {},
+            [&](std::shared_ptr<TopLevelItem::Func> func_def) {
+                walk_body(func_def->body);
+            },
+            [&](std::shared_ptr<TopLevelItem::Actor> actor_def) {
+                for(auto &actor_mem: actor_def->actor_members) {
+                    std::visit([&](const auto& member_def) {
+                        walk_body(member_def->body);
+                    }, actor_mem);
+                }
+            }
+        }, top_level_item.t);
+    }
+    std::unordered_map<std::string, uint64_t> lock_id_map;
+    for(const std::string& lock_name: lock_names) {
+        lock_id_map.emplace(lock_name, lock_id_map.size());
+    }
+    return lock_id_map;
+}
+
+// Records the declarations of the callables of [partition] in [plan], with the attributes of the
+// functions and constructors from [callable_attributes]
+void collect_callable_declarations(
+    GenState& gen_state, 
+    CodegenPlan& plan, 
+    size_t partition,
+    const std::unordered_map<std::string, std::string>& callable_attributes) {
+    auto declare = [&](const std::string& llvm_name, const std::string& llvm_return_type, 
+        const std::vector<std::string>& param_types, bool fastcc, bool exported = false) {
+        CodegenPlan::CallableInfo callable_info{partition};
+        callable_info.internal = !exported;
+        callable_info.fastcc = fastcc;
+        auto attributes = callable_attributes.find(llvm_name);
+        callable_info.attributes = attributes != callable_attributes.end() ? attributes->second : "nounwind";
+        std::ostringstream declaration;
+        map_emit_llvm_function_decl<std::string>(
+            declaration, 
+            llvm_name, 
+            llvm_return_type, 
+            param_types, 
+            [](const std::string& s) {return s;},
+            fastcc ? "fastcc " : "");
+        declaration << " " << callable_info.attributes;
+        callable_info.declaration = declaration.str();
+        plan.callables.emplace(llvm_name, callable_info);
+    };
+    auto declare_synchronous = [&](const std::string& llvm_name, const std::string& llvm_return_type,
+        const std::vector<TopLevelItem::VarDecl>& params) {
+        std::vector<std::string> param_types;
+        for(const auto& [llvm_type, reg]: synchronous_callable_params(gen_state, params)) {
+            param_types.push_back(llvm_type);
+        }
+        declare(llvm_name, llvm_return_type, param_types, true);
+    };
+    const CodegenPartition& codegen_partition = plan.partitions[partition];
+    for(std::shared_ptr<TopLevelItem::Func> func_def: codegen_partition.funcs) {
+        declare_synchronous(
+            llvm_name_of_func(gen_state, func_def->name), 
+            llvm_type_of_coh_type(gen_state, func_def->return_type)->llvm_type_name,
+            func_def->params);
+    }
+    for(std::shared_ptr<TopLevelItem::Actor> actor_def: codegen_partition.actors) {
+        gen_state.curr_actor = actor_def;
+        Defer d([&](){gen_state.curr_actor = nullptr;});
+        for(auto &actor_mem: actor_def->actor_members) {
+            std::visit(Overload{
+                [&](std::shared_ptr<TopLevelItem::Func> func_def) {
+                    declare_synchronous(
+                        llvm_name_of_func(gen_state, func_def->name), 
+                        llvm_type_of_coh_type(gen_state, func_def->return_type)->llvm_type_name,
+                        func_def->params);
+                },
+                [&](std::shared_ptr<TopLevelItem::Constructor> constr_def) {
+                    declare_synchronous(
+                        llvm_name_of_constructor(constr_def->name, actor_def->name), 
+                        "void", 
+                        constr_def->params);
+                },
+                [&](std::shared_ptr<TopLevelItem::Behaviour> be_def) {
+                    // Embedding hosts send messages to behaviours by name
+                    declare(llvm_name_of_behaviour(be_def->name, actor_def->name), "void", {"ptr", "ptr"}, false, true);
+                }
+            }, actor_mem);
+        }
+        declare(llvm_name_of_actor_drop(actor_def->name), "void", {"ptr"}, false);
+        plan.descriptors.emplace(llvm_name_of_actor_descriptor(actor_def->name), CodegenPlan::DescriptorInfo{partition});
+        uint32_t be_index = 0;
+        for(auto &actor_mem: actor_def->actor_members) {
+            if(auto be_def = std::get_if<std::shared_ptr<TopLevelItem::Behaviour>>(&actor_mem)) {
+                plan.behaviour_indices.emplace(llvm_name_of_behaviour((*be_def)->name, actor_def->name), be_index++);
+            }
+        }
+    }
+}
+
+CodegenPlan plan_codegen(Program* program_ast, size_t max_partitions) {
+    // Units that are placed in a partition as a whole, with their number of callables
+    struct Unit {
+        size_t size;
+        std::vector<std::shared_ptr<TopLevelItem::Func>> funcs;
+        std::shared_ptr<TopLevelItem::Actor> actor;
+    };
+    std::vector<Unit> units;
+    for(const TopLevelItem& top_level_item: program_ast->top_level_items) {
+        std::visit(Overload{
+            [&](const TopLevelItem::TypeDef& type_def) {},
+            [&](std::shared_ptr<TopLevelItem::Func> func_def) {
+                if(units.empty() || units.back().actor != nullptr 
+                    || units.back().funcs.size() == FUNCTIONS_PER_CHUNK) {
+                    units.push_back(Unit{0, {}, nullptr});
+                }
+                units.back().funcs.push_back(func_def);
+                units.back().size++;
+            },
+            [&](std::shared_ptr<TopLevelItem::Actor> actor_def) {
+                units.push_back(Unit{actor_def->actor_members.size() + 1, {}, actor_def});
+            }
+        }, top_level_item.t);
+    }
+
+    CodegenPlan plan;
+    plan.partitions.resize(std::max<size_t>(1, std::min(max_partitions, units.size())));
+    plan.partitions[0].has_entry_points = true;
+    // Largest units first, each to the partition with the fewest callables so far
+    std::vector<size_t> units_by_size(units.size());
+    std::iota(units_by_size.begin(), units_by_size.end(), 0);
+    std::stable_sort(units_by_size.begin(), units_by_size.end(), [&](size_t lhs, size_t rhs) {
+        return units[lhs].size > units[rhs].size;
+    });
+    std::vector<size_t> partition_sizes(plan.partitions.size(), 0);
+    std::vector<size_t> unit_partition(units.size());
+    for(size_t unit: units_by_size) {
+        size_t partition = std::min_element(partition_sizes.begin(), partition_sizes.end()) 
+            - partition_sizes.begin();
+        partition_sizes[partition] += units[unit].size;
+        unit_partition[unit] = partition;
+    }
+    // Partitions keep the order of the program
+    for(size_t i = 0; i < units.size(); i++) {
+        const Unit& unit = units[i];
+        CodegenPartition& codegen_partition = plan.partitions[unit_partition[i]];
+        codegen_partition.funcs.insert(codegen_partition.funcs.end(), unit.funcs.begin(), unit.funcs.end());
+        if(unit.actor) {
+            codegen_partition.actors.push_back(unit.actor);
+        }
+    }
+
+    plan.lock_id_map = assign_lock_ids(program_ast);
+    // Only needed to map the types in the signatures
+    std::ostringstream struct_definitions;
+    GenState gen_state(struct_definitions);
+    generate_llvm_structs(gen_state, program_ast);
+    std::unordered_map<std::string, std::string> callable_attributes = 
+        infer_callable_attributes(gen_state, program_ast);
+    for(size_t partition = 0; partition < plan.partitions.size(); partition++) {
+        collect_callable_declarations(gen_state, plan, partition, callable_attributes);
+    }
+    // Callables only their own partition references are internal, which lets LLVM drop the unused
+    // ones and inline the others freely
+    std::unordered_map<std::string, std::unordered_set<size_t>> referencing_partitions;
+    for(size_t partition = 0; partition < plan.partitions.size(); partition++) {
+        for(const std::string& llvm_name: collect_referenced_symbols(gen_state, plan.partitions[partition])) {
+            referencing_partitions[llvm_name].insert(partition);
+        }
+    }
+    auto only_referenced_by = [&](const std::string& llvm_name, size_t own_partition) {
+        return std::ranges::all_of(referencing_partitions[llvm_name], [&](size_t partition) {
+            return partition == own_partition;
+        });
+    };
+    for(auto& [llvm_name, callable_info]: plan.callables) {
+        callable_info.internal = callable_info.internal && only_referenced_by(llvm_name, callable_info.partition);
+    }
+    for(auto& [llvm_name, descriptor_info]: plan.descriptors) {
+        descriptor_info.internal = only_referenced_by(llvm_name, descriptor_info.partition);
+    }
+    return plan;
+}
+
+// Declares the callables and actor descriptors of other partitions that [partition_ir] references
+void emit_external_declarations(
+    std::ostream& out_stream, 
+    const CodegenPlan& plan, 
+    size_t partition, 
+    const std::string& partition_ir) {
+    std::unordered_set<std::string> declared;
+    for(size_t i = 0; i < partition_ir.size(); i++) {
+        if(partition_ir[i] != '@') {
+            continue;
+        }
+        size_t name_end = i + 1;
+        while(name_end < partition_ir.size() && 
+            (std::isalnum(static_cast<unsigned char>(partition_ir[name_end])) || 
+            partition_ir[name_end] == '.' || partition_ir[name_end] == '_')) {
+            name_end++;
+        }
+        std::string name = partition_ir.substr(i + 1, name_end - i - 1);
+        i = name_end - 1;
+        auto callable_it = plan.callables.find(name);
+        if(callable_it != plan.callables.end() && callable_it->second.partition != partition && 
+            declared.insert(name).second) {
+            out_stream << callable_it->second.declaration << std::endl;
+        }
+        auto descriptor_it = plan.descriptors.find(name);
+        if(descriptor_it != plan.descriptors.end() && descriptor_it->second.partition != partition && 
+            declared.insert(name).second) {
+            out_stream << "@" << name << " = external constant %ActorDescriptor.runtime" << std::endl;
+        }
+    }
+}
+
+void codegen_partition(
+    Program* program_ast, 
+    const CodegenPlan& plan, 
+    size_t partition, 
+    std::ostream& out_stream, 
+    const CodegenOptions& options) {
+    // With several partitions, the IR is scanned for references to the others once it is complete
+    std::ostringstream partition_ir;
+    bool single_partition = plan.partitions.size() == 1;
+    GenState gen_state(single_partition ? out_stream : partition_ir);
+    gen_state.stack_promotion = options.stack_promotion;
+    gen_state.ssa_locals = options.ssa_locals;
+    gen_state.alias_metadata = options.alias_metadata;
+    gen_state.direct_dispatch = options.direct_dispatch;
+    gen_state.reorder_fields = options.reorder_fields;
     gen_state.curr_actor = nullptr;
+    gen_state.lock_id_map = plan.lock_id_map;
+    gen_state.plan = &plan;
     ScopeGuard top_level(gen_state.func_llvm_name_map);
     generate_declarations(gen_state);
     generate_llvm_structs(gen_state, program_ast);
-    // Collecting all the toplevel functions
+    // Collecting all the toplevel functions, including those of other partitions
     for(const TopLevelItem& top_level_item: program_ast->top_level_items) {
         std::visit(Overload{
             [&](const TopLevelItem::TypeDef& type_def) {},
@@ -819,46 +1634,80 @@ void ast_codegen(Program* program_ast, std::string output_file_name) {
             [&](std::shared_ptr<TopLevelItem::Actor> actor_def) {}
         }, top_level_item.t);
     }
-    for(const TopLevelItem& top_level_item: program_ast->top_level_items) {
-        std::visit(Overload{
-            [&](const TopLevelItem::TypeDef& type_def) {},
-            [&](std::shared_ptr<TopLevelItem::Func> func_def) {
-                emit_function(gen_state, func_def);
-            },
-            [&](std::shared_ptr<TopLevelItem::Actor> actor_def) {
-                gen_state.curr_actor = actor_def;
-                Defer d([&](){gen_state.curr_actor = nullptr;});
-                ScopeGuard actor_level(gen_state.func_llvm_name_map);
-                for(auto &actor_mem: actor_def->actor_members) {
-                    std::visit(Overload{
-                        [&](std::shared_ptr<TopLevelItem::Func> func_def) {
-                            gen_state.func_llvm_name_map.insert(
-                                func_def->name, 
-                                llvm_name_of_func(gen_state, func_def->name));
-                        },
-                        [&](const auto&){}
-                    }, actor_mem);
-                }
-                
-                // Compiling the members
-                for(auto &actor_mem: actor_def->actor_members) {
-                    std::visit(Overload{
-                        [&](std::shared_ptr<TopLevelItem::Func> func_def) {
-                            emit_function(gen_state, func_def);
-                        },
-                        [&](std::shared_ptr<TopLevelItem::Constructor> constr_def) {
-                            emit_constructor(gen_state, constr_def);
-                        },
-                        [&](std::shared_ptr<TopLevelItem::Behaviour> be_def) {
-                            emit_behaviour(gen_state, be_def);
-                        }
-                    }, actor_mem);
+    const CodegenPartition& codegen_partition = plan.partitions[partition];
+    for(std::shared_ptr<TopLevelItem::Func> func_def: codegen_partition.funcs) {
+        emit_function(gen_state, func_def);
+    }
+    for(std::shared_ptr<TopLevelItem::Actor> actor_def: codegen_partition.actors) {
+        gen_state.curr_actor = actor_def;
+        Defer d([&](){gen_state.curr_actor = nullptr;});
+        ScopeGuard actor_level(gen_state.func_llvm_name_map);
+        for(auto &actor_mem: actor_def->actor_members) {
+            std::visit(Overload{
+                [&](std::shared_ptr<TopLevelItem::Func> func_def) {
+                    gen_state.func_llvm_name_map.insert(
+                        func_def->name, 
+                        llvm_name_of_func(gen_state, func_def->name));
+                },
+                [&](const auto&){}
+            }, actor_mem);
+        }
+        
+        // Compiling the members
+        for(auto &actor_mem: actor_def->actor_members) {
+            std::visit(Overload{
+                [&](std::shared_ptr<TopLevelItem::Func> func_def) {
+                    emit_function(gen_state, func_def);
+                },
+                [&](std::shared_ptr<TopLevelItem::Constructor> constr_def) {
+                    emit_constructor(gen_state, constr_def);
+                },
+                [&](std::shared_ptr<TopLevelItem::Behaviour> be_def) {
+                    emit_behaviour(gen_state, be_def);
                 }
-                gen_state.curr_actor = nullptr;
-            }
-        }, top_level_item.t);
+            }, actor_mem);
+        }
+        emit_actor_drop(gen_state, actor_def);
+        emit_actor_dispatch(gen_state, actor_def);
+    }
+    if(codegen_partition.has_entry_points) {
+        generate_fake_start_actor(gen_state);
+        generate_coherence_initialize(gen_state);
+        gen_state.out_stream << "@num_locks = global i64 " << gen_state.lock_id_map.size() << std::endl;
+        gen_state.out_stream << "@unbuffered_output = global i8 " << (options.unbuffered_output ? 1 : 0) << std::endl;
+        gen_state.out_stream << "@coh_allocator_backend = global i8 " << static_cast<int>(options.allocator) << std::endl;
+    }
+    if(gen_state.alias_metadata) {
+        generate_tbaa_metadata(gen_state);
     }
-    generate_fake_start_actor(gen_state);
-    generate_coherence_initialize(gen_state);
-    gen_state.out_stream << "@num_locks = global i64 " << gen_state.lock_id_map.size() << std::endl;
+    if(!single_partition) {
+        std::string ir = partition_ir.str();
+        out_stream << ir;
+        emit_external_declarations(out_stream, plan, partition, ir);
+    }
+}
+
+void write_layout_report(Program* program_ast, std::ostream& out_stream, const CodegenOptions& options) {
+    std::ostringstream struct_definitions;
+    GenState gen_state(struct_definitions);
+    gen_state.reorder_fields = options.reorder_fields;
+    gen_state.layout_report = &out_stream;
+    generate_llvm_structs(gen_state, program_ast);
+}
+
+void write_host_header(Program* program_ast, std::ostream& out_stream, const CodegenOptions& options) {
+    std::ostringstream struct_definitions;
+    GenState gen_state(struct_definitions);
+    gen_state.reorder_fields = options.reorder_fields;
+    gen_state.host_header = &out_stream;
+    out_stream << "// Generated by the Coherence compiler. Messages of the behaviours of Main, for sending\n"
+    << "// to it with coh_runtime_send (see coherence_runtime.h).\n"
+    << "#pragma once\n#include <stdbool.h>\n#include <stdint.h>\n\n"
+    << "#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n";
+    generate_llvm_structs(gen_state, program_ast);
+    out_stream << "\n#ifdef __cplusplus\n}\n#endif\n";
+}
+
+void ast_codegen(Program* program_ast, std::ostream& out_stream, const CodegenOptions& options) {
+    codegen_partition(program_ast, plan_codegen(program_ast, 1), 0, out_stream, options);
 }
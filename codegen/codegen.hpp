@@ -1,4 +1,96 @@
+#pragma once
 #include "top_level.hpp"
-#include <string>
+#include "runtime_traps.hpp"
+#include <ostream>
+#include <unordered_map>
+#include <vector>
 
-void ast_codegen(Program* program_ast, std::string output_file_name);
\ No newline at end of file
+struct CodegenOptions {
+    // Makes the runtime write every OUT straight to stdout instead of buffering it
+    bool unbuffered_output = false;
+    // Places small arrays that escape analysis proved local to one call in the stack frame
+    bool stack_promotion = true;
+    // Keeps the scalar locals and parameters of callables in SSA registers instead of stack slots
+    bool ssa_locals = true;
+    // Tells LLVM through TBAA metadata that actor members, message fields and array elements, and
+    // values of different types, never alias
+    bool alias_metadata = true;
+    // Makes the dispatch function of each actor switch on the behaviour index and call the
+    // behaviours directly, instead of calling them through the table in its descriptor
+    bool direct_dispatch = true;
+    // Orders the fields of actor and message structs to remove padding and group the members
+    // accessed together, instead of keeping the declaration order
+    bool reorder_fields = true;
+    // Implementation of [coh_alloc] the program uses
+    AllocatorBackend allocator = AllocatorBackend::ACTOR_HEAP;
+};
+
+/*
+A part of the program that is compiled into its own LLVM module. Partitions only reference each
+other through declarations of their callables and actor descriptors, so they can be generated and
+compiled in parallel and linked afterwards.
+*/
+struct CodegenPartition {
+    std::vector<std::shared_ptr<TopLevelItem::Func>> funcs;
+    std::vector<std::shared_ptr<TopLevelItem::Actor>> actors;
+    // Whether the partition holds [coherence_initialize], [start.runtime] and the program globals
+    bool has_entry_points = false;
+};
+
+struct CodegenPlan {
+    std::vector<CodegenPartition> partitions;
+    // Atomic sections acquire their locks in id order, so the ids are fixed for the whole program
+    std::unordered_map<std::string, uint64_t> lock_id_map;
+    struct CallableInfo {
+        size_t partition;
+        // `declare` of the callable, for the partitions that reference it
+        std::string declaration;
+        // Set when no other partition references the callable, which is then defined internal.
+        // Behaviours never are, as embedding hosts send messages to them.
+        bool internal = false;
+        // Functions and constructors are only called by generated code, and use fastcc. The
+        // runtime calls behaviours and drop functions with the C calling convention.
+        bool fastcc = false;
+        // Function attributes of the definition and the declarations, e.g. "nounwind readnone"
+        std::string attributes;
+    };
+    // By llvm name of the callable
+    std::unordered_map<std::string, CallableInfo> callables;
+    // The <Actor>.descriptor constant of every actor (see [ActorDescriptor]), which the partitions
+    // creating instances of the actor reference
+    struct DescriptorInfo {
+        size_t partition;
+        // Set when no other partition creates instances of the actor
+        bool internal = true;
+    };
+    // By llvm name of the descriptor
+    std::unordered_map<std::string, DescriptorInfo> descriptors;
+    // Messages name the behaviour they run by its index in the descriptor of its actor. By llvm
+    // name of the behaviour.
+    std::unordered_map<std::string, uint32_t> behaviour_indices;
+};
+
+// Splits [program_ast] into at most [max_partitions] partitions of similar size. The members of an
+// actor always stay together, top-level functions are spread in chunks.
+CodegenPlan plan_codegen(Program* program_ast, size_t max_partitions);
+
+// Writes the textual LLVM IR of partition [partition] of [plan] to [out_stream]. Partitions of the
+// same plan can be generated concurrently.
+void codegen_partition(
+    Program* program_ast, 
+    const CodegenPlan& plan, 
+    size_t partition, 
+    std::ostream& out_stream, 
+    const CodegenOptions& options);
+
+// Writes the size of every actor and message struct, in declaration order and as laid out with
+// [options], and the order of its fields to [out_stream]
+void write_layout_report(Program* program_ast, std::ostream& out_stream, const CodegenOptions& options);
+
+// Writes a C header for embedding hosts to [out_stream]: the message struct and the behaviour of
+// every behaviour of [Main], as laid out with [options], and the struct types they use. Dots in llvm
+// names become underscores, so %add.Main.be.struct is declared as struct add_Main_be_struct.
+void write_host_header(Program* program_ast, std::ostream& out_stream, const CodegenOptions& options);
+
+// Writes the textual LLVM IR of the program, as a single module, to [out_stream]
+void ast_codegen(Program* program_ast, std::ostream& out_stream, const CodegenOptions& options);
\ No newline at end of file
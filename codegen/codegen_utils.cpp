@@ -2,6 +2,7 @@
 #include "pattern_matching_boilerplate.hpp"
 #include "special_reg_names.hpp"
 #include "ast_walkers.hpp"
+#include <algorithm>
 
 std::unordered_map<std::string, std::shared_ptr<const Type>> collect_local_variable_types(
         std::vector<std::shared_ptr<Stmt>>& callable_body) {
@@ -25,6 +26,24 @@ std::unordered_map<std::string, std::shared_ptr<const Type>> collect_local_varia
     return local_vars;
 }
 
+void walk_callable_body(
+    const std::vector<std::shared_ptr<Stmt>>& body,
+    std::function<void(std::shared_ptr<ValExpr>)> valexpr_action,
+    std::function<void(std::shared_ptr<Stmt>)> stmt_action) {
+    std::function<void(std::shared_ptr<ValExpr>)> valexpr_walker;
+    valexpr_walker = [&](std::shared_ptr<ValExpr> val_expr) {
+        valexpr_action(val_expr);
+        visitor_valexpr_walker(val_expr, valexpr_walker);
+    };
+    std::function<void(std::shared_ptr<Stmt>)> stmt_walker;
+    stmt_walker = [&](std::shared_ptr<Stmt> stmt) {
+        stmt_action(stmt);
+        valexpr_and_stmt_visitors_stmt_walker(stmt, valexpr_walker, stmt_walker);
+    };
+    for(std::shared_ptr<Stmt> stmt: body) {
+        stmt_walker(stmt);
+    }
+}
 
 std::string llvm_name_of_func(GenState& gen_state, const std::string& func_name) {
     if(gen_state.curr_actor != nullptr) {
@@ -53,6 +72,18 @@ std::string llvm_struct_of_actor(const std::string& actor_name) {
     return actor_name + ".struct";
 }
 
+std::string llvm_name_of_actor_drop(const std::string& actor_name) {
+    return actor_name + ".drop";
+}
+
+std::string llvm_name_of_actor_dispatch(const std::string& actor_name) {
+    return actor_name + ".dispatch";
+}
+
+std::string llvm_name_of_actor_descriptor(const std::string& actor_name) {
+    return actor_name + ".descriptor";
+}
+
 std::shared_ptr<LLVMTypeInfo> llvm_type_of_coh_type(
     GenState& gen_state,
     std::shared_ptr<const Type> type) {
@@ -102,6 +133,36 @@ std::string get_llvm_type_size(GenState &gen_state, const std::string& llvm_type
     return size_reg;
 }
 
+std::pair<uint64_t, uint64_t> llvm_type_layout(std::shared_ptr<LLVMTypeInfo> llvm_type) {
+    if(llvm_type->struct_info != nullptr) {
+        std::vector<std::shared_ptr<LLVMTypeInfo>> fields;
+        for(const LLVMStructInfo::FieldInfo& field_info: llvm_type->struct_info->ind_field_map) {
+            fields.push_back(field_info.field_type);
+        }
+        return llvm_struct_layout(fields);
+    }
+    const std::string& name = llvm_type->llvm_type_name;
+    if(name == "i1") {
+        return {1, 1};
+    }
+    if(name == "i32") {
+        return {4, 4};
+    }
+    assert(name == "i64" || name == "ptr");
+    return {8, 8};
+}
+
+std::pair<uint64_t, uint64_t> llvm_struct_layout(const std::vector<std::shared_ptr<LLVMTypeInfo>>& fields) {
+    uint64_t size = 0;
+    uint64_t alignment = 1;
+    for(auto& field: fields) {
+        auto [field_size, field_alignment] = llvm_type_layout(field);
+        size = (size + field_alignment - 1) / field_alignment * field_alignment + field_size;
+        alignment = std::max(alignment, field_alignment);
+    }
+    return {(size + alignment - 1) / alignment * alignment, alignment};
+}
+
 void allocate_var_to_stack(
     GenState& gen_state,
     const std::string& llvm_type,
@@ -120,20 +181,75 @@ std::string convert_i32_to_i64(GenState& gen_state, const std::string& i32_reg)
     return size64_reg;
 }
 
+std::string convert_count_to_i64(GenState& gen_state, const std::string& i32_reg) {
+    // %negative = icmp slt i32 %count, 0
+    // %clamped = select i1 %negative, i32 0, i32 %count
+    std::string negative_reg = gen_state.reg_label_gen.new_temp_reg();
+    gen_state.out_stream << "%" + negative_reg << " = icmp slt i32 " << "%" + i32_reg << ", 0" << std::endl;
+    std::string clamped_reg = gen_state.reg_label_gen.new_temp_reg();
+    gen_state.out_stream << "%" + clamped_reg << " = select i1 " << "%" + negative_reg 
+    << ", i32 0, i32 " << "%" + i32_reg << std::endl;
+    return convert_i32_to_i64(gen_state, clamped_reg);
+}
+
 void branch_label(GenState& gen_state, const std::string& label) {
     gen_state.out_stream << "br label " << "%" + label << std::endl;
 }
 
+void emit_label(GenState& gen_state, const std::string& label) {
+    gen_state.out_stream << label << ":" << std::endl;
+    gen_state.curr_block = label;
+}
+
+bool is_ssa_local_type(std::shared_ptr<LLVMTypeInfo> llvm_type) {
+    return llvm_type->struct_info == nullptr && !llvm_type_holds_actors(llvm_type);
+}
+
+// TBAA type nodes: a root, then one scalar type per memory kind (in [MemoryKind] order) and llvm
+// type, each followed by its access tag
+static const std::vector<std::string> TBAA_MEMORY_KINDS = {"member", "message", "element"};
+static const std::vector<std::string> TBAA_SCALAR_TYPES = {"i1", "i32", "i64", "ptr"};
+
+void generate_tbaa_metadata(GenState& gen_state) {
+    gen_state.out_stream << "!0 = !{!\"coherence tbaa\"}" << std::endl;
+    size_t type_node = 1;
+    for(const std::string& memory_kind: TBAA_MEMORY_KINDS) {
+        for(const std::string& scalar_type: TBAA_SCALAR_TYPES) {
+            gen_state.out_stream << "!" << type_node << " = !{!\"" << memory_kind << " " << scalar_type 
+            << "\", !0, i64 0}" << std::endl;
+            gen_state.out_stream << "!" << type_node + 1 << " = !{!" << type_node << ", !" << type_node 
+            << ", i64 0}" << std::endl;
+            type_node += 2;
+        }
+    }
+}
+
+std::string tbaa_annotation(GenState& gen_state, const std::string& llvm_type, const std::string& pointer_reg) {
+    if(!gen_state.alias_metadata) {
+        return "";
+    }
+    auto memory_kind = gen_state.pointer_memory_kinds.find(pointer_reg);
+    auto scalar_type = std::find(TBAA_SCALAR_TYPES.begin(), TBAA_SCALAR_TYPES.end(), llvm_type);
+    if(memory_kind == gen_state.pointer_memory_kinds.end() || scalar_type == TBAA_SCALAR_TYPES.end()) {
+        return "";
+    }
+    size_t type_index = static_cast<size_t>(memory_kind->second) * TBAA_SCALAR_TYPES.size() + 
+        (scalar_type - TBAA_SCALAR_TYPES.begin());
+    return ", !tbaa !" + std::to_string(2 * type_index + 2);
+}
+
+void allocate_suspend_tag(GenState& gen_state) {
+    gen_state.out_stream << "%" + SUSPEND_TAG_REG << " = alloca %SuspendTag.runtime" << std::endl;
+}
+
 void generate_suspend_call(
     GenState& gen_state,
     SuspendTag suspend_tag) {
     // struct name is %SuspendTag.runtime
-    // Creating the [SuspendTag] struct on the heap
+    // Filling out the [SuspendTag] struct in the callable's stack slot. The runtime reads it
+    // before the stack of a returning behaviour is freed.
     std::string llvm_struct_type_name = "%SuspendTag.runtime";
-    std::string suspend_struct_size = get_llvm_type_size(gen_state, llvm_struct_type_name);
-    std::string suspend_struct_ptr_reg = gen_state.reg_label_gen.new_temp_reg();
-    gen_state.out_stream << "%" << suspend_struct_ptr_reg << " = call ptr @malloc(i64 " << 
-    "%" << suspend_struct_size << ")" << std::endl;
+    std::string suspend_struct_ptr_reg = SUSPEND_TAG_REG;
 
     // Getting the pointer to the kind field
     std::string kind_ptr_reg = gen_state.reg_label_gen.new_temp_reg();
@@ -155,4 +271,151 @@ void generate_suspend_call(
     // The actor instance to be locked is stored in %lock_instance.runtime.
     gen_state.out_stream << "call void @suspend_instance(i64 " << "%" + SYNCHRONOUS_ACTOR_ID_REG 
     << ", ptr " << "%" + suspend_struct_ptr_reg << ")" << std::endl;
-}
\ No newline at end of file
+}
+
+bool llvm_type_holds_actors(std::shared_ptr<LLVMTypeInfo> llvm_type) {
+    if(llvm_type->struct_info == nullptr) {
+        return llvm_type->llvm_type_name == "i64";
+    }
+    for(const LLVMStructInfo::FieldInfo& field_info: llvm_type->struct_info->ind_field_map) {
+        if(llvm_type_holds_actors(field_info.field_type)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void emit_actor_ref_update(
+    GenState& gen_state,
+    const std::string& trap,
+    std::shared_ptr<LLVMTypeInfo> llvm_type,
+    const std::string& value_reg,
+    const std::string& count_reg) {
+    if(llvm_type->struct_info == nullptr) {
+        if(llvm_type->llvm_type_name == "i64") {
+            gen_state.out_stream << "call void @" << trap << "(i64 " << "%" + value_reg;
+            if(!count_reg.empty()) {
+                gen_state.out_stream << ", i64 " << "%" + count_reg;
+            }
+            gen_state.out_stream << ")" << std::endl;
+        }
+        return;
+    }
+    for(const LLVMStructInfo::FieldInfo& field_info: llvm_type->struct_info->ind_field_map) {
+        if(!llvm_type_holds_actors(field_info.field_type)) {
+            continue;
+        }
+        // %<field_reg> = extractvalue %<struct_type> %<value_reg>, field_index
+        std::string field_reg = gen_state.reg_label_gen.new_temp_reg();
+        gen_state.out_stream << "%" + field_reg << " = extractvalue " << llvm_type->llvm_type_name << " "
+        << "%" + value_reg << ", " << field_info.field_index << std::endl;
+        emit_actor_ref_update(gen_state, trap, field_info.field_type, field_reg, count_reg);
+    }
+}
+
+bool is_zero_constant(std::shared_ptr<ValExpr> val_expr) {
+    return std::visit(Overload{
+        [&](const ValExpr::VUnit&) {
+            return true;
+        },
+        [&](const ValExpr::VNullptr&) {
+            return true;
+        },
+        [&](const ValExpr::VInt& v_int) {
+            return v_int.v == 0;
+        },
+        [&](const ValExpr::VBool& v_bool) {
+            return !v_bool.v;
+        },
+        [&](const ValExpr::VStruct& vstruct) {
+            for(auto& [field_name, field_expr]: vstruct.fields) {
+                if(!is_zero_constant(field_expr)) {
+                    return false;
+                }
+            }
+            return true;
+        },
+        [&](const auto&) {
+            return false;
+        }
+    }, val_expr->t);
+}
+
+void own_actor_refs(
+    GenState& gen_state,
+    std::shared_ptr<LLVMTypeInfo> llvm_type,
+    const std::string& value_reg) {
+    if(llvm_type_holds_actors(llvm_type)) {
+        gen_state.owned_actor_refs.push_back({value_reg, llvm_type});
+    }
+}
+
+void release_owned_actor_refs(GenState& gen_state, size_t first) {
+    for(size_t i = first; i < gen_state.owned_actor_refs.size(); i++) {
+        auto &[value_reg, llvm_type] = gen_state.owned_actor_refs[i];
+        emit_actor_ref_update(gen_state, "actor_release", llvm_type, value_reg);
+    }
+    gen_state.owned_actor_refs.resize(std::min(first, gen_state.owned_actor_refs.size()));
+}
+
+void release_actor_ref_slots(GenState& gen_state) {
+    for(auto &[slot_reg, llvm_type]: gen_state.actor_ref_slots) {
+        std::string value_reg = gen_state.reg_label_gen.new_temp_reg();
+        gen_state.out_stream << "%" + value_reg << " = load " << llvm_type->llvm_type_name << ", ptr "
+        << "%" + slot_reg << std::endl;
+        emit_actor_ref_update(gen_state, "actor_release", llvm_type, value_reg);
+    }
+}
+
+// Larger arrays stay in the arena, so that deep recursion can not overflow the behaviour's stack
+static constexpr int MAX_FRAME_ARRAY_ELEMENTS = 64;
+
+void allocate_frame_arrays(GenState& gen_state, std::vector<std::shared_ptr<Stmt>>& callable_body) {
+    if(!gen_state.stack_promotion) {
+        return;
+    }
+    std::function<void(std::shared_ptr<ValExpr>)> valexpr_action;
+    valexpr_action = [&](std::shared_ptr<ValExpr> val_expr) {
+        std::visit(Overload{
+            [&](const ValExpr::NewInstance& new_instance) {
+                if(!new_instance.constant_frame_size || 
+                    *new_instance.constant_frame_size > MAX_FRAME_ARRAY_ELEMENTS) {
+                    return;
+                }
+                std::string elem_type = 
+                    llvm_type_of_coh_type(gen_state, new_instance.type)->llvm_type_name;
+                std::string slot_reg = gen_state.reg_label_gen.new_stack_var();
+                // %<slot_reg> = alloca [<n> x <elem_type>]
+                gen_state.out_stream << "%" + slot_reg << " = alloca [" << *new_instance.constant_frame_size 
+                << " x " << elem_type << "]" << std::endl;
+                gen_state.frame_array_slots.emplace(&new_instance, slot_reg);
+            },
+            [&](const auto&){}
+        }, val_expr->t);
+        visitor_valexpr_walker(val_expr, valexpr_action);
+    };
+    for(auto stmt: callable_body) {
+        valexpr_visitor_stmt_walker(stmt, valexpr_action);
+    }
+}
+
+void end_frame_array_lifetimes(GenState& gen_state) {
+    for(auto &[new_instance, slot_reg]: gen_state.frame_array_slots) {
+        gen_state.out_stream << "call void @llvm.lifetime.end.p0(i64 -1, ptr " << "%" + slot_reg << ")" 
+        << std::endl;
+    }
+}
+
+std::string allocate_actor_struct(GenState& gen_state, const std::string& actor_name) {
+    std::string actor_struct_type = "%" + llvm_struct_of_actor(actor_name);
+    std::string actor_struct_size = get_llvm_type_size(gen_state, actor_struct_type);
+    std::string actor_struct_ptr = gen_state.reg_label_gen.new_temp_reg();
+    // %<actor_struct_ptr> = call ptr @coh_alloc(i64 %<actor_struct_size>)
+    gen_state.out_stream << "%" << actor_struct_ptr << " = call ptr @coh_alloc(i64 "
+    << "%" << actor_struct_size << ")" << std::endl;
+    // The members are zeroed, so dropping an actor whose constructor did not initialise all of
+    // them releases nothing
+    gen_state.out_stream << "store " << actor_struct_type << " zeroinitializer, ptr " 
+    << "%" + actor_struct_ptr << std::endl;
+    return actor_struct_ptr;
+}
@@ -1,11 +1,18 @@
 #pragma once
 #include <string>
+#include <functional>
 #include "generator_state.hpp"
 #include "top_level.hpp"
 #include "runtime_traps.hpp"
 
 std::unordered_map<std::string, std::shared_ptr<const Type>> collect_local_variable_types(
         std::vector<std::shared_ptr<Stmt>>& callable_body);
+// Calls [valexpr_action] on every expression and [stmt_action] on every statement of [body],
+// nested ones included
+void walk_callable_body(
+    const std::vector<std::shared_ptr<Stmt>>& body,
+    std::function<void(std::shared_ptr<ValExpr>)> valexpr_action,
+    std::function<void(std::shared_ptr<Stmt>)> stmt_action);
 std::string llvm_name_of_func(GenState& gen_state, const std::string& func_name);
 std::string llvm_name_of_constructor(
     const std::string& constructor_name, 
@@ -14,17 +21,69 @@ std::string llvm_name_of_constructor(
 std::string llvm_name_of_behaviour(const std::string& be_name, const std::string& actor_name);
 std::string llvm_struct_of_behaviour(const std::string& be_name, const std::string& actor_name);
 std::string llvm_struct_of_actor(const std::string& actor_name);
+std::string llvm_name_of_actor_drop(const std::string& actor_name);
+std::string llvm_name_of_actor_dispatch(const std::string& actor_name);
+std::string llvm_name_of_actor_descriptor(const std::string& actor_name);
 std::shared_ptr<LLVMTypeInfo> llvm_type_of_coh_type(
     GenState& gen_state,
     std::shared_ptr<const Type> type);
 std::string actor_name_of_coh_type(std::shared_ptr<const Type> type);
 std::string get_llvm_type_size(GenState &gen_state, const std::string& llvm_type_name);
+// {size, alignment} in bytes of [llvm_type], or of a struct with [fields], when the size is needed
+// while generating code (x86-64 data layout)
+std::pair<uint64_t, uint64_t> llvm_type_layout(std::shared_ptr<LLVMTypeInfo> llvm_type);
+std::pair<uint64_t, uint64_t> llvm_struct_layout(const std::vector<std::shared_ptr<LLVMTypeInfo>>& fields);
 void allocate_var_to_stack(
     GenState& gen_state,
     const std::string& llvm_type,
     const std::string& var_name);
 std::string convert_i32_to_i64(GenState& gen_state, const std::string& i32_reg);
+// Widens a number of actors or messages to i64, with a negative count standing for none
+std::string convert_count_to_i64(GenState& gen_state, const std::string& i32_reg);
 void branch_label(GenState& gen_state, const std::string& label);
+// Starts the basic block [label], which becomes [gen_state.curr_block]
+void emit_label(GenState& gen_state, const std::string& label);
+// Whether a variable of [llvm_type] can be kept in an SSA register: a scalar holding no actor
+// references (those are released through their stack slot when the callable exits)
+bool is_ssa_local_type(std::shared_ptr<LLVMTypeInfo> llvm_type);
+// Defines the TBAA metadata that [tbaa_annotation] refers to, once per module
+void generate_tbaa_metadata(GenState& gen_state);
+// The metadata attachment (", !tbaa !<n>") of a load or store of [llvm_type] through [pointer_reg].
+// Empty for aggregates and for pointers of unknown [MemoryKind], which may alias anything.
+std::string tbaa_annotation(GenState& gen_state, const std::string& llvm_type, const std::string& pointer_reg);
+// Allocates the stack slot [generate_suspend_call] passes to the runtime. Must be emitted in
+// the entry block of every callable that can suspend.
+void allocate_suspend_tag(GenState& gen_state);
 void generate_suspend_call(
     GenState& gen_state,
-    SuspendTag suspend_tag);
\ No newline at end of file
+    SuspendTag suspend_tag);
+// Allocates a zeroed struct for an instance of [actor_name] and returns the register pointing to it
+std::string allocate_actor_struct(GenState& gen_state, const std::string& actor_name);
+
+// Whether values of [llvm_type] contain actor ids (the only values lowered to i64)
+bool llvm_type_holds_actors(std::shared_ptr<LLVMTypeInfo> llvm_type);
+// Calls [trap] (actor_retain or actor_release) on every actor id contained in [value_reg]. With
+// [count_reg], [trap] (actor_retain_many) also takes the number of references as an i64.
+void emit_actor_ref_update(
+    GenState& gen_state,
+    const std::string& trap,
+    std::shared_ptr<LLVMTypeInfo> llvm_type,
+    const std::string& value_reg,
+    const std::string& count_reg = "");
+// Whether [val_expr] is a constant whose representation is all zero bits
+bool is_zero_constant(std::shared_ptr<ValExpr> val_expr);
+// Records that the current statement owns the actor references in [value_reg]
+void own_actor_refs(
+    GenState& gen_state,
+    std::shared_ptr<LLVMTypeInfo> llvm_type,
+    const std::string& value_reg);
+// Releases the references owned by the current statement, starting from the [first]th one
+void release_owned_actor_refs(GenState& gen_state, size_t first);
+// Releases the references held by [gen_state.actor_ref_slots] before the callable exits
+void release_actor_ref_slots(GenState& gen_state);
+
+// Allocates the stack slots of the arrays in [callable_body] that live in the callable's frame
+// (see [NewInstance::constant_frame_size]). Must be emitted in the entry block.
+void allocate_frame_arrays(GenState& gen_state, std::vector<std::shared_ptr<Stmt>>& callable_body);
+// Ends the lifetime of the arrays in [gen_state.frame_array_slots] before the callable exits
+void end_frame_array_lifetimes(GenState& gen_state);
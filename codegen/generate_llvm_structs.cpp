@@ -3,8 +3,75 @@
 #include "codegen_utils.hpp"
 #include "string_utils.hpp"
 #include "pattern_matching_boilerplate.hpp"
+#include "struct_layout.hpp"
 #include "defer.cpp"
+#include <algorithm>
 #include <cassert>
+#include <numeric>
+
+// Writes "<struct>: <size in declaration order> -> <size> bytes (<field> <type>, ...)" to the
+// layout report. [fields] are in declaration order, [order] is the order they are listed in.
+static void report_struct_layout(
+    GenState& gen_state,
+    const std::string& struct_name,
+    const std::vector<std::string>& field_names,
+    const std::vector<std::shared_ptr<LLVMTypeInfo>>& fields,
+    const std::vector<size_t>& order) {
+    if(gen_state.layout_report == nullptr) {
+        return;
+    }
+    std::vector<std::shared_ptr<LLVMTypeInfo>> ordered_fields;
+    for(size_t field: order) {
+        ordered_fields.push_back(fields[field]);
+    }
+    std::ostream& report = *gen_state.layout_report;
+    report << struct_name << ": " << llvm_struct_layout(fields).first << " -> " 
+    << llvm_struct_layout(ordered_fields).first << " bytes (";
+    map_emit_list<size_t>(report, order, ", ", [&](size_t field) {
+        return field_names[field] + " " + fields[field]->llvm_type_name;
+    });
+    report << ")" << std::endl;
+}
+
+// C spelling of [name], an llvm struct or callable name such as add.Main.be
+static std::string c_identifier_of_llvm_name(std::string name) {
+    std::replace(name.begin(), name.end(), '.', '_');
+    return name;
+}
+
+// C type with the size and alignment of [llvm_type_name] as a struct field
+static std::string c_type_of_llvm_type(const std::string& llvm_type_name) {
+    if(llvm_type_name == "i1") {
+        return "bool";
+    }
+    if(llvm_type_name == "i32") {
+        return "int32_t";
+    }
+    if(llvm_type_name == "i64") {
+        return "uint64_t";
+    }
+    if(llvm_type_name == "ptr") {
+        return "void*";
+    }
+    // %<type>.struct
+    assert(llvm_type_name.starts_with("%"));
+    return "struct " + c_identifier_of_llvm_name(llvm_type_name.substr(1));
+}
+
+// Writes the C declaration of [struct_name] with [fields], pairs of {<name>, <llvm type>} in
+// layout order, to the host header
+static void write_host_struct(
+    GenState& gen_state,
+    const std::string& struct_name,
+    const std::vector<std::pair<std::string, std::string>>& fields) {
+    std::ostream& header = *gen_state.host_header;
+    header << "struct " << c_identifier_of_llvm_name(struct_name) << " {" << std::endl;
+    for(auto const& [field_name, llvm_type_name]: fields) {
+        header << "    " << c_type_of_llvm_type(llvm_type_name) << " " 
+        << c_identifier_of_llvm_name(field_name) << ";" << std::endl;
+    }
+    header << "};" << std::endl;
+}
 
 void emit_type_definition(
     GenState& gen_state, 
@@ -40,6 +107,14 @@ void emit_type_definition(
             gen_state.type_name_info_map.emplace(
                 type_name,
                 llvm_type_info);
+            if(gen_state.host_header != nullptr) {
+                std::vector<std::pair<std::string, std::string>> fields;
+                for(auto const& [field_name, field_type]: struct_type.members) {
+                    fields.push_back(
+                        {field_name, llvm_type_of_coh_type(gen_state, field_type)->llvm_type_name});
+                }
+                write_host_struct(gen_state, struct_name, fields);
+            }
         }
     }, type_def.nameable_type->t);
 }
@@ -49,10 +124,21 @@ void emit_actor_struct(
     const std::shared_ptr<TopLevelItem::Actor>& actor_def) {
     // Emit the actor struct type
     std::string llvm_actor_struct = llvm_struct_of_actor(actor_def->name);
+    std::vector<std::shared_ptr<LLVMTypeInfo>> member_types;
+    for (const std::string& mem_name : actor_def->member_var_order) {
+        member_types.push_back(llvm_type_of_coh_type(gen_state, actor_def->member_vars.at(mem_name)));
+    }
+    std::vector<size_t> member_order(member_types.size());
+    std::iota(member_order.begin(), member_order.end(), 0);
+    if (gen_state.reorder_fields) {
+        member_order = order_actor_fields(actor_def, member_types);
+    }
+    report_struct_layout(gen_state, llvm_actor_struct, actor_def->member_var_order, member_types, member_order);
     std::vector<std::pair<std::string, std::shared_ptr<const Type>>> struct_mem_vec;
-    struct_mem_vec.reserve(actor_def->member_vars.size());
-    for (auto const& mem_var : actor_def->member_vars) {
-        struct_mem_vec.push_back(mem_var);
+    struct_mem_vec.reserve(member_order.size());
+    for (size_t mem_ind : member_order) {
+        const std::string& mem_name = actor_def->member_var_order[mem_ind];
+        struct_mem_vec.push_back({mem_name, actor_def->member_vars.at(mem_name)});
     }
 
     map_emit_struct<std::pair<std::string, std::shared_ptr<const Type>>>(
@@ -87,17 +173,38 @@ void emit_behaviour_struct(
     std::string actor_name = gen_state.curr_actor->name;
     std::string be_struct_llvm = llvm_struct_of_behaviour(behaviour_def->name, actor_name);
 
-    std::vector<std::pair<std::string, std::string>> struct_mem_vec;
-    struct_mem_vec.reserve(behaviour_def->params.size() + 1);
-
+    std::vector<std::string> field_names;
+    std::vector<std::shared_ptr<LLVMTypeInfo>> fields;
     for (auto const& var_decl : behaviour_def->params) {
-        struct_mem_vec.push_back({
-            var_decl.name,
-            llvm_type_of_coh_type(gen_state, var_decl.type)->llvm_type_name
-        });
+        field_names.push_back(var_decl.name);
+        fields.push_back(llvm_type_of_coh_type(gen_state, var_decl.type));
+    }
+    std::vector<size_t> param_order(fields.size());
+    std::iota(param_order.begin(), param_order.end(), 0);
+    if (gen_state.reorder_fields) {
+        param_order = order_message_fields(fields);
+    }
+    std::vector<size_t>& param_field_indices = gen_state.message_field_indices[be_struct_llvm];
+    param_field_indices.assign(fields.size(), 0);
+    std::vector<std::pair<std::string, std::string>> struct_mem_vec;
+    struct_mem_vec.reserve(fields.size() + 1);
+    for (size_t param_ind : param_order) {
+        param_field_indices[param_ind] = struct_mem_vec.size();
+        struct_mem_vec.push_back({field_names[param_ind], fields[param_ind]->llvm_type_name});
     }
 
     struct_mem_vec.push_back({THIS_ACTOR_ID_REG, "i64"});
+    field_names.push_back(THIS_ACTOR_ID_REG);
+    fields.push_back(std::make_shared<LLVMTypeInfo>("i64"));
+    param_order.push_back(fields.size() - 1);
+    report_struct_layout(gen_state, be_struct_llvm, field_names, fields, param_order);
+    // Embedding hosts can only address [Main], and build its messages themselves
+    if (gen_state.host_header != nullptr && actor_name == "Main") {
+        write_host_struct(gen_state, be_struct_llvm, struct_mem_vec);
+        std::string be_llvm = llvm_name_of_behaviour(behaviour_def->name, actor_name);
+        *gen_state.host_header << "void " << c_identifier_of_llvm_name(be_llvm) 
+        << "(void* message, void* actor) __asm__(\"" << be_llvm << "\");" << std::endl;
+    }
 
     map_emit_struct<std::pair<std::string, std::string>>(
         gen_state.out_stream,
@@ -1,6 +1,7 @@
 // Class that generates characters for registers to be used somehow
 #pragma once
 #include <cstddef>
+#include <map>
 #include <string>
 #include <unordered_map>
 #include <memory>
@@ -35,6 +36,15 @@ public:
 };
 
 struct LLVMTypeInfo;
+struct CodegenPlan;
+
+// Memory the program data lives in. Loads and stores of different kinds, or of different scalar
+// types, never alias, which the generated code tells LLVM through TBAA metadata.
+enum class MemoryKind {
+    ACTOR_MEMBER,
+    MESSAGE_FIELD,
+    ARRAY_ELEMENT
+};
 
 struct LLVMStructInfo {
     struct FieldInfo {
@@ -71,7 +81,52 @@ struct GenState {
     // Also, the struct associated with the actor is %actor_name.struct
     std::shared_ptr<TopLevelItem::Actor> curr_actor = nullptr;
     std::unordered_map<std::string, uint64_t> lock_id_map;
+    // How the callables of the whole program are defined and called (see [CodegenPlan::CallableInfo])
+    const CodegenPlan* plan = nullptr;
     std::vector<uint64_t> locks_acquired;
+    // Locations holding actor references that the current callable releases when it exits: its
+    // locals, parameters, and for behaviours the parameters in the message. Pairs of
+    // {<pointer reg>, <llvm type of the location>}
+    std::vector<std::pair<std::string, std::shared_ptr<LLVMTypeInfo>>> actor_ref_slots;
+    // Values holding actor references that the statement being compiled owns, and releases once
+    // it completes (new actors, results of calls and values overwritten by assignments).
+    // Pairs of {<value reg>, <llvm type of the value>}
+    std::vector<std::pair<std::string, std::shared_ptr<LLVMTypeInfo>>> owned_actor_refs;
+    // Whether arrays with [NewInstance::constant_frame_size] are allocated on the stack
+    bool stack_promotion = true;
+    // The stack slots (allocas in the entry block) of the arrays the current callable places in
+    // its frame
+    std::unordered_map<const ValExpr::NewInstance*, std::string> frame_array_slots;
+    // Whether the scalar locals and parameters that hold no actor references are kept in SSA
+    // registers (see [is_ssa_local_type])
+    bool ssa_locals = true;
+    // The variables of the current callable kept in SSA registers, with their llvm types, and the
+    // register holding the current value of each. Variables not in these maps live in
+    // [var_reg_mapping].
+    std::map<std::string, std::string> ssa_var_types;
+    std::map<std::string, std::string> ssa_var_values;
+    // Label of the basic block being emitted, for the phis of the blocks it branches to
+    std::string curr_block;
+    // Whether loads and stores of program data carry TBAA metadata (see [tbaa_annotation])
+    bool alias_metadata = true;
+    // Whether the dispatch function of an actor calls its behaviours directly, or through its
+    // table of behaviours
+    bool direct_dispatch = true;
+    // Whether the fields of actor and message structs are reordered (see struct_layout.hpp), or
+    // listed in declaration order
+    bool reorder_fields = true;
+    // The field index of each parameter of a behaviour in its message struct, by llvm name of the
+    // struct. The receiver id is always the last field.
+    std::unordered_map<std::string, std::vector<size_t>> message_field_indices;
+    // When set, [generate_llvm_structs] writes the size and fields of every actor and message
+    // struct to it
+    std::ostream* layout_report = nullptr;
+    // When set, [generate_llvm_structs] writes C declarations of the struct types and of the
+    // messages and behaviours of [Main] to it (see [write_host_header])
+    std::ostream* host_header = nullptr;
+    // The kind of memory the pointer registers of the current callable point into. Pointers to
+    // stack slots and runtime structures are not recorded.
+    std::unordered_map<std::string, MemoryKind> pointer_memory_kinds;
     // File to which llvm needs to be written to
     std::ostream& out_stream;
     GenState(): out_stream(std::cout) {}
@@ -79,5 +134,12 @@ struct GenState {
     void refresh_var_reg_info() {
         reg_label_gen.refresh_counters();
         var_reg_mapping.clear();
+        actor_ref_slots.clear();
+        owned_actor_refs.clear();
+        frame_array_slots.clear();
+        ssa_var_types.clear();
+        ssa_var_values.clear();
+        curr_block.clear();
+        pointer_memory_kinds.clear();
     }
 };
\ No newline at end of file
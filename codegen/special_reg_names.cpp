@@ -1,4 +1,6 @@
 #include "special_reg_names.hpp"
 
 extern const std::string THIS_ACTOR_ID_REG = "this.id";
-extern const std::string SYNCHRONOUS_ACTOR_ID_REG = "sync_actor.id";
\ No newline at end of file
+extern const std::string THIS_ACTOR_STRUCT_REG = "this.struct";
+extern const std::string SYNCHRONOUS_ACTOR_ID_REG = "sync_actor.id";
+extern const std::string SUSPEND_TAG_REG = "suspend_tag.slot";
@@ -1,4 +1,6 @@
 #include <string>
 
 extern const std::string THIS_ACTOR_ID_REG;
-extern const std::string SYNCHRONOUS_ACTOR_ID_REG;
\ No newline at end of file
+extern const std::string THIS_ACTOR_STRUCT_REG;
+extern const std::string SYNCHRONOUS_ACTOR_ID_REG;
+extern const std::string SUSPEND_TAG_REG;
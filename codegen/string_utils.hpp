@@ -33,14 +33,16 @@ void map_emit_struct(
     output_file << " }" << std::endl;
 }
 
+// [linkage] goes before the return type, e.g. "internal fastcc "
 template <typename T>
 void map_emit_llvm_function_sig(
     std::ostream& output_file,
     const std::string& function_name,
     const std::string& llvm_return_type,
     const std::vector<T>& parameters,
-    std::function<std::string(T)> llvm_param_gen) {
-    output_file << "define " << llvm_return_type << " " << "@" << function_name << "(";
+    std::function<std::string(T)> llvm_param_gen,
+    const std::string& linkage = "") {
+    output_file << "define " << linkage << llvm_return_type << " " << "@" << function_name << "(";
     map_emit_list<T>(
         output_file, 
         parameters, 
@@ -50,14 +52,16 @@ void map_emit_llvm_function_sig(
     output_file << ")";
 }
 
+// [linkage] goes before the return type, e.g. "fastcc "
 template <typename T>
 void map_emit_llvm_function_decl(
     std::ostream& output_file,
     const std::string& function_name,
     const std::string& llvm_return_type,
     const std::vector<T>& parameters,
-    std::function<std::string(T)> llvm_param_gen) {
-    output_file << "declare " << llvm_return_type << " " << "@" << function_name << "(";
+    std::function<std::string(T)> llvm_param_gen,
+    const std::string& linkage = "") {
+    output_file << "declare " << linkage << llvm_return_type << " " << "@" << function_name << "(";
     map_emit_list<T>(
         output_file, 
         parameters, 
@@ -0,0 +1,178 @@
+#include "struct_layout.hpp"
+#include "codegen_utils.hpp"
+#include "pattern_matching_boilerplate.hpp"
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <set>
+
+// Actor structs are assumed to start on a cache line when counting the lines a callable touches
+static constexpr uint64_t CACHE_LINE_SIZE = 64;
+
+// Sorts [order] by decreasing alignment of the fields, keeping the relative order of fields with
+// the same alignment
+static void sort_by_alignment(
+    std::vector<size_t>& order,
+    const std::vector<std::shared_ptr<LLVMTypeInfo>>& fields) {
+    std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+        return llvm_type_layout(fields[lhs]).second > llvm_type_layout(fields[rhs]).second;
+    });
+}
+
+// The offset of every field (by index into [fields]) when they are placed in [order]
+static std::vector<uint64_t> field_offsets(
+    const std::vector<size_t>& order,
+    const std::vector<std::shared_ptr<LLVMTypeInfo>>& fields) {
+    std::vector<uint64_t> offsets(fields.size());
+    uint64_t offset = 0;
+    for(size_t field: order) {
+        auto [field_size, field_alignment] = llvm_type_layout(fields[field]);
+        offset = (offset + field_alignment - 1) / field_alignment * field_alignment;
+        offsets[field] = offset;
+        offset += field_size;
+    }
+    return offsets;
+}
+
+// For each behaviour and function of [actor_def], the indices of the members (in declaration
+// order) it reads or writes. Constructors run once per actor and are left out.
+static std::vector<std::set<size_t>> member_accesses(std::shared_ptr<TopLevelItem::Actor> actor_def) {
+    std::unordered_map<std::string, size_t> member_indices;
+    for(size_t i = 0; i < actor_def->member_var_order.size(); i++) {
+        member_indices.emplace(actor_def->member_var_order[i], i);
+    }
+    std::vector<std::set<size_t>> accesses;
+    auto add_callable = [&](const std::vector<TopLevelItem::VarDecl>& params,
+        std::vector<std::shared_ptr<Stmt>>& body) {
+        std::unordered_map<std::string, std::shared_ptr<const Type>> locals = collect_local_variable_types(body);
+        for(const TopLevelItem::VarDecl& param: params) {
+            locals.emplace(param.name, param.type);
+        }
+        std::set<size_t> accessed;
+        auto access = [&](const std::string& var_name) {
+            auto member = member_indices.find(var_name);
+            if(member != member_indices.end() && !locals.contains(var_name)) {
+                accessed.insert(member->second);
+            }
+        };
+        walk_callable_body(body, [&](std::shared_ptr<ValExpr> val_expr) {
+            std::visit(Overload{
+                [&](const ValExpr::VVar& var) {
+                    access(var.name);
+                },
+                [&](const ValExpr::Unalias& unalias) {
+                    access(unalias.var_name);
+                },
+                [&](const auto&) {}
+            }, val_expr->t);
+        }, [](std::shared_ptr<Stmt>) {});
+        accesses.push_back(std::move(accessed));
+    };
+    for(auto& actor_mem: actor_def->actor_members) {
+        std::visit(Overload{
+            [&](std::shared_ptr<TopLevelItem::Func> func_def) {
+                add_callable(func_def->params, func_def->body);
+            },
+            [&](std::shared_ptr<TopLevelItem::Behaviour> be_def) {
+                add_callable(be_def->params, be_def->body);
+            },
+            [&](std::shared_ptr<TopLevelItem::Constructor>) {}
+        }, actor_mem);
+    }
+    return accesses;
+}
+
+// Total number of cache lines the callables touch, each reading or writing the fields in
+// [accesses], when the fields are placed in [order]
+static size_t cache_lines_touched(
+    const std::vector<size_t>& order,
+    const std::vector<std::shared_ptr<LLVMTypeInfo>>& fields,
+    const std::vector<std::set<size_t>>& accesses) {
+    std::vector<uint64_t> offsets = field_offsets(order, fields);
+    size_t lines_touched = 0;
+    for(const std::set<size_t>& accessed: accesses) {
+        std::set<uint64_t> lines;
+        for(size_t field: accessed) {
+            uint64_t field_size = llvm_type_layout(fields[field]).first;
+            for(uint64_t line = offsets[field] / CACHE_LINE_SIZE;
+                line <= (offsets[field] + std::max<uint64_t>(field_size, 1) - 1) / CACHE_LINE_SIZE; line++) {
+                lines.insert(line);
+            }
+        }
+        lines_touched += lines.size();
+    }
+    return lines_touched;
+}
+
+/*
+Members accessed by the same set of callables form a group. Groups accessed by more callables come
+first, and members no callable accesses last. Within a group the members are ordered by alignment,
+alternately decreasing and increasing, so the small members at the end of a group share their
+padding with those at the start of the next one.
+*/
+static std::vector<size_t> member_access_groups(
+    const std::vector<std::shared_ptr<LLVMTypeInfo>>& fields,
+    const std::vector<std::set<size_t>>& accesses) {
+    std::vector<std::vector<size_t>> accessed_by(fields.size());
+    for(size_t callable = 0; callable < accesses.size(); callable++) {
+        for(size_t field: accesses[callable]) {
+            accessed_by[field].push_back(callable);
+        }
+    }
+    // Keyed by the callables accessing the members. Members are added in declaration order.
+    std::map<std::vector<size_t>, std::vector<size_t>> groups;
+    for(size_t field = 0; field < fields.size(); field++) {
+        groups[accessed_by[field]].push_back(field);
+    }
+    std::vector<const std::vector<size_t>*> group_order;
+    for(auto& [callables, members]: groups) {
+        group_order.push_back(&members);
+    }
+    std::stable_sort(group_order.begin(), group_order.end(), [&](auto lhs, auto rhs) {
+        size_t lhs_callables = accessed_by[lhs->front()].size();
+        size_t rhs_callables = accessed_by[rhs->front()].size();
+        if(lhs_callables != rhs_callables) {
+            return lhs_callables > rhs_callables;
+        }
+        return lhs->front() < rhs->front();
+    });
+    std::vector<size_t> order;
+    for(size_t i = 0; i < group_order.size(); i++) {
+        std::vector<size_t> members = *group_order[i];
+        sort_by_alignment(members, fields);
+        if(i % 2 == 1) {
+            std::reverse(members.begin(), members.end());
+        }
+        order.insert(order.end(), members.begin(), members.end());
+    }
+    return order;
+}
+
+std::vector<size_t> order_actor_fields(
+    std::shared_ptr<TopLevelItem::Actor> actor_def,
+    const std::vector<std::shared_ptr<LLVMTypeInfo>>& fields) {
+    std::vector<size_t> packed(fields.size());
+    std::iota(packed.begin(), packed.end(), 0);
+    sort_by_alignment(packed, fields);
+    // A struct that fits in a cache line can not do better than the smallest size
+    std::vector<std::shared_ptr<LLVMTypeInfo>> packed_fields;
+    for(size_t field: packed) {
+        packed_fields.push_back(fields[field]);
+    }
+    if(llvm_struct_layout(packed_fields).first <= CACHE_LINE_SIZE) {
+        return packed;
+    }
+    std::vector<std::set<size_t>> accesses = member_accesses(actor_def);
+    std::vector<size_t> grouped = member_access_groups(fields, accesses);
+    if(cache_lines_touched(grouped, fields, accesses) < cache_lines_touched(packed, fields, accesses)) {
+        return grouped;
+    }
+    return packed;
+}
+
+std::vector<size_t> order_message_fields(const std::vector<std::shared_ptr<LLVMTypeInfo>>& fields) {
+    std::vector<size_t> order(fields.size());
+    std::iota(order.begin(), order.end(), 0);
+    sort_by_alignment(order, fields);
+    return order;
+}
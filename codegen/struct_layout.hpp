@@ -0,0 +1,22 @@
+#pragma once
+#include <vector>
+#include "generator_state.hpp"
+
+/*
+LLVM places the fields of a struct in the order they are listed, padding each to its alignment, so
+the order decides the size of the struct. These functions return the order the fields of the
+generated structs are listed in, as indices into [fields].
+*/
+
+// The members of [actor_def], with [fields] their types in declaration order (see
+// [Actor::member_var_order]). Ordered by decreasing alignment, which leaves no padding. When
+// another order lets the behaviours and functions of the actor touch fewer cache lines in total,
+// the members they access together are grouped instead (see [member_access_groups]).
+std::vector<size_t> order_actor_fields(
+    std::shared_ptr<TopLevelItem::Actor> actor_def,
+    const std::vector<std::shared_ptr<LLVMTypeInfo>>& fields);
+
+// The parameters of a behaviour, with [fields] their types. Ordered by decreasing alignment; the
+// i64 receiver id always follows them, as the runtime fills it in for broadcasts (see
+// [handle_broadcast_behaviour_call]).
+std::vector<size_t> order_message_fields(const std::vector<std::shared_ptr<LLVMTypeInfo>>& fields);
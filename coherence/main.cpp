@@ -3,12 +3,20 @@
 #include <filesystem>
 #include <cstdio>
 #include <optional>
+#include <unordered_map>
 #include <cstdlib>
 #include <format>
 #include "top_level.hpp"
 #include "ast_validator.hpp"
 #include "codegen.hpp"
 #include "parse_file.hpp"
+#include "llvm_backend.hpp"
+#include "jit_runner.hpp"
+#include "parallel_for.hpp"
+#include <sstream>
+#include <fstream>
+#include <thread>
+#include <vector>
 
 #include <boost/program_options.hpp>
 namespace po = boost::program_options;
@@ -22,6 +30,20 @@ int main(int argc, char* argv[]) {
         ("input-file", po::value<std::string>()->required(), "coherence program to compile")
         ("only-typecheck", po::value<bool>(), "whether to only typecheck the program")
         ("optimize", po::value<bool>(), "whether to optimize the program")
+        ("single-threaded", po::value<bool>(), "whether to link against the single-threaded runtime")
+        ("emit-object", po::value<bool>(), "whether to stop at an object file (out.o) for embedding in a host program, with a header for the host (out.h)")
+        ("unbuffered-output", po::value<bool>(), "whether to write every OUT to stdout immediately (for debugging)")
+        ("stack-promotion", po::value<bool>(), "whether to place small arrays that never leave their callable on the stack (default true)")
+        ("ssa-locals", po::value<bool>(), "whether scalar locals and parameters are kept in SSA registers instead of stack slots (default true)")
+        ("alias-metadata", po::value<bool>(), "whether loads and stores carry TBAA metadata telling apart actor members, message fields and array elements (default true)")
+        ("reorder-fields", po::value<bool>(), "whether the fields of actor and message structs are ordered to remove padding and keep the members behaviours access together, instead of in declaration order (default true)")
+        ("layout-report", po::value<bool>(), "whether to write the size of every actor and message struct before and after reordering its fields (layout_report.txt)")
+        ("direct-dispatch", po::value<bool>(), "whether each actor's dispatch function calls its behaviours directly instead of through a table of function pointers (default true)")
+        ("run", po::value<bool>(), "whether to run the program in the JIT instead of building an executable")
+        ("jobs", po::value<size_t>(), "number of threads compiling the program, which is split into as many LLVM modules (default: number of cores)")
+        ("lto", po::value<bool>(), "whether --optimize links the program with the runtime bitcode and optimizes them together (default false, needs a runtime built with clang 14)")
+        ("emit-llvm", po::value<bool>(), "whether to also write the generated IR (out_raw.ll, and out_opt.ll when optimizing) for debugging")
+        ("allocator", po::value<std::string>(), "allocator backend of the program: actor-heap (default), libc, size-class or bump (never frees)")
         ("output-dir", po::value<std::string>(), "directory where the generated files will be stored");
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -42,6 +64,86 @@ int main(int argc, char* argv[]) {
         optimize = vm["optimize"].as<bool>();
     }
 
+    bool single_threaded = false;
+    if(vm.count("single-threaded")) {
+        single_threaded = vm["single-threaded"].as<bool>();
+    }
+
+    bool emit_object = false;
+    if(vm.count("emit-object")) {
+        emit_object = vm["emit-object"].as<bool>();
+    }
+
+    bool run = false;
+    if(vm.count("run")) {
+        run = vm["run"].as<bool>();
+    }
+    if(run && emit_object) {
+        std::cerr << "Error: --run and --emit-object can not be combined" << std::endl;
+        return 1;
+    }
+
+    bool emit_llvm = false;
+    if(vm.count("emit-llvm")) {
+        emit_llvm = vm["emit-llvm"].as<bool>();
+    }
+
+    // Executables only: the JIT and embedding hosts load or link the runtime themselves
+    bool lto = false;
+    if(vm.count("lto")) {
+        lto = vm["lto"].as<bool>() && optimize && !run && !emit_object;
+    }
+#ifndef COH_RUNTIME_BITCODE_PATH
+    if(lto) {
+        std::cerr << "Error: --lto needs the runtime bitcode, which is only built when clang 14 is found "
+        "at configure time" << std::endl;
+        return 1;
+    }
+#endif
+
+    size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+    if(vm.count("jobs")) {
+        jobs = std::max<size_t>(1, vm["jobs"].as<size_t>());
+    }
+
+    CodegenOptions codegen_options;
+    if(vm.count("unbuffered-output")) {
+        codegen_options.unbuffered_output = vm["unbuffered-output"].as<bool>();
+    }
+    if(vm.count("stack-promotion")) {
+        codegen_options.stack_promotion = vm["stack-promotion"].as<bool>();
+    }
+    if(vm.count("ssa-locals")) {
+        codegen_options.ssa_locals = vm["ssa-locals"].as<bool>();
+    }
+    if(vm.count("alias-metadata")) {
+        codegen_options.alias_metadata = vm["alias-metadata"].as<bool>();
+    }
+    if(vm.count("direct-dispatch")) {
+        codegen_options.direct_dispatch = vm["direct-dispatch"].as<bool>();
+    }
+    if(vm.count("reorder-fields")) {
+        codegen_options.reorder_fields = vm["reorder-fields"].as<bool>();
+    }
+    bool layout_report = false;
+    if(vm.count("layout-report")) {
+        layout_report = vm["layout-report"].as<bool>();
+    }
+    if(vm.count("allocator")) {
+        const std::unordered_map<std::string, AllocatorBackend> allocators = {
+            {"actor-heap", AllocatorBackend::ACTOR_HEAP},
+            {"libc", AllocatorBackend::LIBC},
+            {"size-class", AllocatorBackend::SIZE_CLASS},
+            {"bump", AllocatorBackend::BUMP}
+        };
+        std::string allocator = vm["allocator"].as<std::string>();
+        if(!allocators.contains(allocator)) {
+            std::cerr << "Error: unknown allocator " << allocator << std::endl;
+            return 1;
+        }
+        codegen_options.allocator = allocators.at(allocator);
+    }
+
     std::filesystem::path input_file(vm["input-file"].as<std::string>());
 
     if (!std::filesystem::exists(input_file)) {
@@ -75,54 +177,162 @@ int main(int argc, char* argv[]) {
         return 0;
     }
     
-    if(!vm.count("output-dir")) {
+    // Running in the JIT writes nothing, unless the IR or the layout report is requested
+    if(!vm.count("output-dir") && (!run || emit_llvm || layout_report)) {
         std::cerr << "Error: Output directory not provided" << std::endl;
         delete program_root;
         return 1;
     }
-    std::filesystem::path output_dir(vm["output-dir"].as<std::string>());
+    std::filesystem::path output_dir(vm.count("output-dir") ? vm["output-dir"].as<std::string>() : ".");
     if(!std::filesystem::exists(output_dir)) {
         if(!std::filesystem::create_directories(output_dir)) {
             std::cerr << "Error: could not create output directory" << std::endl;
         }
     }
 
-    // 3. LLVM code generation
-    std::filesystem::path out_raw_ll_path = output_dir / "out_raw.ll";
-    ast_codegen(program_root, out_raw_ll_path.string());
-    std::cout << "Compilation successful\n";
+    if(layout_report) {
+        std::ofstream layout_report_file(output_dir / "layout_report.txt");
+        write_layout_report(program_root, layout_report_file, codegen_options);
+    }
+    // Hosts include out.h for the layouts of the messages they send to [Main]
+    if(emit_object) {
+        std::ofstream host_header_file(output_dir / "out.h");
+        write_host_header(program_root, host_header_file, codegen_options);
+    }
+
+    // 3. LLVM code generation, optimization and code generation of the partitions of the program,
+    // each in its own module, on [jobs] threads
+    CodegenPlan codegen_plan = plan_codegen(program_root, jobs);
+    size_t num_partitions = codegen_plan.partitions.size();
+    // Files of partition [i] get a ".<i>" suffix once there are several
+    auto partition_file = [&](const std::string& stem, const std::string& extension, size_t i) {
+        std::string suffix = num_partitions == 1 ? "" : "." + std::to_string(i);
+        return (output_dir / (stem + suffix + extension)).string();
+    };
+    initialize_llvm_backend();
+    if(optimize && !run) {
+        std::cout << "Running LLVM optimizer\n";
+    }
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> jit_objects(num_partitions);
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> lto_bitcode(num_partitions);
+    std::vector<char> partition_ok(num_partitions, false);
+    parallel_for(num_partitions, jobs, [&](size_t i) {
+        std::ostringstream llvm_ir;
+        codegen_partition(program_root, codegen_plan, i, llvm_ir, codegen_options);
+        if(emit_llvm) {
+            std::ofstream out_raw_ll(partition_file("out_raw", ".ll", i));
+            out_raw_ll << llvm_ir.str();
+        }
+        llvm::LLVMContext llvm_context;
+        std::unique_ptr<llvm::Module> module = parse_llvm_ir(llvm_context, llvm_ir.str());
+        if(!module) {
+            return;
+        }
+        // Target machines are not shared between threads
+        std::unique_ptr<llvm::TargetMachine> target_machine = create_host_target_machine(optimize);
+        if(!target_machine) {
+            return;
+        }
+        // Optimized again, together with the runtime, once all partitions are done
+        if(lto) {
+            optimize_module(*module, *target_machine, OptimizationStage::LTO_PRE_LINK);
+            lto_bitcode[i] = write_bitcode_buffer(*module);
+            partition_ok[i] = true;
+            return;
+        }
+        if (optimize) {
+            optimize_module(*module, *target_machine);
+            if(emit_llvm && !write_llvm_ir(*module, partition_file("out_opt", ".ll", i))) {
+                return;
+            }
+        }
+        // The JIT links the objects in memory
+        if(run) {
+            jit_objects[i] = emit_object_buffer(*module, *target_machine);
+            if(!jit_objects[i]) {
+                return;
+            }
+        }
+        else if(!emit_object_file(*module, *target_machine, partition_file("out", ".o", i))) {
+            return;
+        }
+        partition_ok[i] = true;
+    });
     delete program_root;
+    if(std::find(partition_ok.begin(), partition_ok.end(), false) != partition_ok.end()) {
+        return 1;
+    }
+    // With --run, stdout belongs to the program
+    if(!run) {
+        std::cout << "Compilation successful\n";
+    }
 
-    std::string final_ll_path = out_raw_ll_path.string();
-    std::string llc_opt_flag = "-O0";
+    if (run) {
+        std::string runtime_lib_path = single_threaded ? COH_JIT_RUNTIME_ST_LIB_PATH : COH_JIT_RUNTIME_LIB_PATH;
+        return run_in_jit(std::move(jit_objects), runtime_lib_path);
+    }
 
-    // Conditionally run the optimizer
-    if (optimize) {
-        std::filesystem::path out_opt_ll_path = output_dir / "out_opt.ll";
-        std::string opt_cmd = std::format("opt -O3 {} -S -o {}", out_raw_ll_path.string(), out_opt_ll_path.string());
-        
-        std::cout << "Running LLVM optimizer\n";
-        if(std::system(opt_cmd.c_str()) != 0) {
-            std::cerr << "Error: optimization failed\n";
+    std::string object_files;
+    for(size_t i = 0; i < num_partitions; i++) {
+        object_files += partition_file("out", ".o", i) + " ";
+    }
+    std::string runtime_lib_path = single_threaded ? COH_RUNTIME_ST_LIB_PATH : COH_RUNTIME_LIB_PATH;
+
+#ifdef COH_RUNTIME_BITCODE_PATH
+    // One module with the runtime, so the optimizer sees through the traps. Code generation is
+    // split over [jobs] threads again afterwards.
+    if (lto) {
+        llvm::LLVMContext lto_context;
+        std::unique_ptr<llvm::Module> lto_module = link_lto_module(
+            lto_context, 
+            lto_bitcode, 
+            single_threaded ? COH_RUNTIME_ST_BITCODE_PATH : COH_RUNTIME_BITCODE_PATH);
+        if(!lto_module) {
+            return 1;
+        }
+        lto_bitcode.clear();
+        std::unique_ptr<llvm::TargetMachine> target_machine = create_host_target_machine(optimize);
+        if(!target_machine) {
+            return 1;
+        }
+        optimize_module(*lto_module, *target_machine, OptimizationStage::LTO);
+        if(emit_llvm && !write_llvm_ir(*lto_module, (output_dir / "out_opt.ll").string())) {
+            return 1;
+        }
+        std::vector<std::string> object_paths;
+        object_files.clear();
+        for(size_t i = 0; i < jobs; i++) {
+            object_paths.push_back((output_dir / ("out.lto." + std::to_string(i) + ".o")).string());
+            object_files += object_paths.back() + " ";
+        }
+        if(!emit_split_object_files(*lto_module, *target_machine, optimize, object_paths)) {
             return 1;
         }
-        final_ll_path = out_opt_ll_path.string();
-        llc_opt_flag = "-O3";
+        // The runtime is part of the objects now
+        runtime_lib_path = "";
     }
+#endif
 
-    // 4. Compiling to assembly
-    std::filesystem::path out_s_path = output_dir / "out.s";
-    std::string obj_compile_cmd = std::format("llc {} {} -o {}", llc_opt_flag, final_ll_path, out_s_path.string());
-    if (std::system(obj_compile_cmd.c_str()) != 0) {
-        std::cerr << "Error: llc failed\n";
-        return 1;
+    // The host links the object against the coherence_embed runtime itself
+    if (emit_object) {
+        // Hosts expect a single object, so the partitions are merged
+        if(num_partitions > 1) {
+            std::string merge_cmd = std::format("ld -r {}-o {}", object_files, (output_dir / "out.o").string());
+            if (std::system(merge_cmd.c_str()) != 0) {
+                std::cerr << "Error: merging the objects failed\n";
+                return 1;
+            }
+        }
+        std::cout << "Built object: ./out.o and header: ./out.h\n";
+        return 0;
     }
 
-    // 5. Link assembly + runtime -> executable
+    // 4. Link objects + runtime -> executable (through the system driver, LLD is not used as a
+    // library yet)
     std::filesystem::path out_path = output_dir / "out";
     std::string link_cmd = std::format(
-        "clang++ {} " COH_RUNTIME_LIB_PATH " -lboost_context -pthread -o {}", 
-        out_s_path.string(), out_path.string());
+        "clang++ {}{} -lboost_context -pthread -o {}", 
+        object_files, runtime_lib_path, out_path.string());
     if (std::system(link_cmd.c_str()) != 0) {
         std::cerr << "Error: link failed\n";
         return 1;
@@ -130,4 +340,4 @@ int main(int argc, char* argv[]) {
 
     std::cout << "Built executable: ./out\n";
     return 0;
-}
\ No newline at end of file
+}
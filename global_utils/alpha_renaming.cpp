@@ -53,6 +53,9 @@ void alpha_rename_val_expr(
             for(auto val_expr: actor_construction.args) {
                 alpha_rename_val_expr(rename_info, val_expr);
             }
+            if(actor_construction.bulk_size != nullptr) {
+                alpha_rename_val_expr(rename_info, actor_construction.bulk_size);
+            }
         },
         [&](ValExpr::Unalias& unalias) {
             rename_info.rename_variable(unalias.var_name);
@@ -103,6 +106,12 @@ void alpha_rename_statement(
             for(auto val_expr: be_call.args) {
                 alpha_rename_val_expr(rename_info, val_expr);
             }
+            if(be_call.delay_ms != nullptr) {
+                alpha_rename_val_expr(rename_info, be_call.delay_ms);
+            }
+            if(be_call.broadcast_count != nullptr) {
+                alpha_rename_val_expr(rename_info, be_call.broadcast_count);
+            }
         },
         [&](Stmt::Print &print_stmt) {
             alpha_rename_val_expr(rename_info, print_stmt.print_expr);
@@ -24,7 +24,7 @@ bool predicate_valexpr_walker(
                     return false;
                 }
             }
-            return true;
+            return actor_construction.bulk_size == nullptr || predicate(actor_construction.bulk_size);
         },
         [&](ValExpr::PointerAccess& pointer_access) {
             // First the pointer then the index
@@ -79,6 +79,12 @@ void valexpr_and_stmt_visitors_stmt_walker(
             for(std::shared_ptr<ValExpr> arg: be_call.args) {
                 val_expr_visitor(arg);
             }
+            if(be_call.delay_ms != nullptr) {
+                val_expr_visitor(be_call.delay_ms);
+            }
+            if(be_call.broadcast_count != nullptr) {
+                val_expr_visitor(be_call.broadcast_count);
+            }
         },
         [&](Stmt::Print& print_expr) {
             val_expr_visitor(print_expr.print_expr);
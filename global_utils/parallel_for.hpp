@@ -0,0 +1,30 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Calls [task] on 0..[count]-1 from [num_threads] threads, each taking the next index once it is
+// done with the previous one. With a single thread everything runs on the calling thread.
+inline void parallel_for(size_t count, size_t num_threads, const std::function<void(size_t)>& task) {
+    std::atomic<size_t> next_index = 0;
+    auto worker = [&]() {
+        for(size_t i = next_index++; i < count; i = next_index++) {
+            task(i);
+        }
+    };
+    if(num_threads <= 1 || count <= 1) {
+        worker();
+        return;
+    }
+    std::vector<std::thread> threads;
+    for(size_t i = 1; i < std::min(num_threads, count); i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for(std::thread& thread: threads) {
+        thread.join();
+    }
+}
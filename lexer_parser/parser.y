@@ -55,7 +55,7 @@
     vector<TopLevelItem::VarDecl>* var_list;
     std::shared_ptr<TopLevelItem::Func>* func;
     std::shared_ptr<TopLevelItem::Actor>* actor;
-    std::unordered_map<std::string, std::shared_ptr<const Type>>* actor_fields;
+    vector<TopLevelItem::VarDecl>* actor_fields;
     std::shared_ptr<TopLevelItem::Constructor>* actor_constructor;
     std::shared_ptr<TopLevelItem::Behaviour>* actor_behaviour;
     Program* program;
@@ -74,7 +74,7 @@
 %token TOK_LPAREN TOK_RPAREN TOK_LBRACE TOK_RBRACE TOK_LSQUARE TOK_RSQUARE
 %token TOK_COLON TOK_SEMI TOK_COMMA
 %token TOK_PLUS TOK_MINUS TOK_STAR TOK_SLASH TOK_MOD
-%token TOK_VAR
+%token TOK_VAR TOK_AFTER TOK_BROADCAST
 
 %token <int_val>   TOK_INT_LIT
 %token <str_val>   TOK_IDENT
@@ -212,16 +212,20 @@ actor_def
         }
         $$ = $5;
         (*$$)->name = std::move(*$2);
-        (*$$)->member_vars = std::move(*$4);
+        for (TopLevelItem::VarDecl& field : *$4) {
+            if ((*$$)->member_vars.emplace(field.name, std::move(field.type)).second) {
+                (*$$)->member_var_order.push_back(std::move(field.name));
+            }
+        }
         delete $2; delete $4;
       }
     ;
 
 actor_fields
-    : %empty { $$ = new unordered_map<std::string, std::shared_ptr<const Type>>(); }
+    : %empty { $$ = new vector<TopLevelItem::VarDecl>(); }
     | actor_fields TOK_IDENT TOK_COLON full_type TOK_SEMI {
         $$ = $1;
-        $$->emplace(std::move(*$2), std::move(*$4));
+        $$->push_back(TopLevelItem::VarDecl{std::move(*$2), std::move(*$4)});
         delete $2; delete $4;
       }
     ;
@@ -350,6 +354,40 @@ stmt
         ));
         delete $1; delete $3; delete $5;
       }
+    | val_expr TOK_SEND TOK_IDENT TOK_LPAREN val_expr_list TOK_RPAREN TOK_AFTER val_expr TOK_IDENT TOK_SEMI {
+        if (*$9 != "ms") {
+            yyerror(&@9, yyscanner,
+                    "Delays must be given in milliseconds ('after <n> ms')");
+            YYERROR;
+        }
+        $$ = new shared_ptr<Stmt>(make_shared<Stmt>(
+            Stmt{
+                span_from(@$),
+                Stmt::BehaviourCall{
+                    *$1,
+                    *$3,
+                    std::move(*$5),
+                    *$8
+                }
+            }
+        ));
+        delete $1; delete $3; delete $5; delete $8; delete $9;
+      }
+    | TOK_BROADCAST TOK_LPAREN val_expr TOK_COMMA val_expr TOK_RPAREN TOK_SEND TOK_IDENT TOK_LPAREN val_expr_list TOK_RPAREN TOK_SEMI {
+        $$ = new shared_ptr<Stmt>(make_shared<Stmt>(
+            Stmt{
+                span_from(@$),
+                Stmt::BehaviourCall{
+                    *$3,
+                    *$8,
+                    std::move(*$10),
+                    nullptr,
+                    *$5
+                }
+            }
+        ));
+        delete $3; delete $5; delete $8; delete $10;
+      }
     | val_expr TOK_SEMI {
         $$ = new shared_ptr<Stmt>(make_shared<Stmt>(
             Stmt{
@@ -733,6 +771,22 @@ primary_expr
         ));
         delete $2; delete $4; delete $6; delete $8;
       }
+    | TOK_NEW cap TOK_LSQUARE val_expr TOK_RSQUARE TOK_IDENT TOK_DOT TOK_IDENT TOK_LPAREN val_expr_list TOK_RPAREN {
+        $$ = new shared_ptr<ValExpr>(make_shared<ValExpr>(
+            ValExpr{
+                span_from(@$),
+                nullptr,
+                ValExpr::ActorConstruction{
+                    std::move(*$6),  // actor_name
+                    std::move(*$8),  // constructor_name
+                    std::move(*$10), // args
+                    std::move(*$4),  // bulk_size
+                    std::move(*$2)   // bulk_cap
+                }
+            }
+        ));
+        delete $2; delete $4; delete $6; delete $8; delete $10;
+      }
     | TOK_NEW TOK_IDENT TOK_DOT TOK_IDENT TOK_LPAREN val_expr_list TOK_RPAREN {
         $$ = new shared_ptr<ValExpr>(make_shared<ValExpr>(
             ValExpr{
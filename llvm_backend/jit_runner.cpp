@@ -0,0 +1,94 @@
+#include "jit_runner.hpp"
+#include "coherence_runtime.h"
+#include <iostream>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/Support/Error.h>
+
+/*
+The runtime reads these symbols from the program. The shared runtime is loaded with dlopen, and the
+dynamic linker can not see into JIT-ed memory, so the compiler exports its own copies (see
+coherence/jit_exports.list) for the runtime to bind to. [run_in_jit] fills them in from the
+definitions in the JIT-ed module before starting the runtime. The generated code never reads them
+itself, so the two copies can not disagree.
+*/
+extern "C" {
+    uint64_t num_locks = 0;
+    uint8_t unbuffered_output = 0;
+    uint8_t coh_allocator_backend = 0;
+}
+static void (*jit_coherence_initialize)() = nullptr;
+extern "C" void coherence_initialize() {
+    jit_coherence_initialize();
+}
+
+static int report_error(llvm::Error error) {
+    std::cerr << "Error: " << llvm::toString(std::move(error)) << std::endl;
+    return 1;
+}
+
+// Address of [name] in the JIT, or null with [error] set. Does nothing once [error] is set, so a
+// sequence of lookups can be checked once at the end.
+template<typename T>
+static T* jit_address(llvm::orc::LLJIT& jit, const char* name, llvm::Error& error) {
+    if(error) {
+        return nullptr;
+    }
+    llvm::Expected<llvm::JITEvaluatedSymbol> symbol = jit.lookup(name);
+    if(!symbol) {
+        error = symbol.takeError();
+        return nullptr;
+    }
+    return reinterpret_cast<T*>(symbol->getAddress());
+}
+
+int run_in_jit(
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects,
+    const std::string& runtime_library_path
+) {
+    llvm::Expected<std::unique_ptr<llvm::orc::LLJIT>> jit = llvm::orc::LLJITBuilder().create();
+    if(!jit) {
+        return report_error(jit.takeError());
+    }
+
+    // Runtime traps resolve to the shared runtime, which also brings in its own dependencies
+    llvm::Expected<std::unique_ptr<llvm::orc::DynamicLibrarySearchGenerator>> runtime_symbols = 
+        llvm::orc::DynamicLibrarySearchGenerator::Load(
+            runtime_library_path.c_str(), 
+            (*jit)->getDataLayout().getGlobalPrefix());
+    if(!runtime_symbols) {
+        return report_error(runtime_symbols.takeError());
+    }
+    (*jit)->getMainJITDylib().addGenerator(std::move(*runtime_symbols));
+
+    for(std::unique_ptr<llvm::MemoryBuffer>& object: objects) {
+        if(llvm::Error error = (*jit)->addObjectFile(std::move(object))) {
+            return report_error(std::move(error));
+        }
+    }
+    if(llvm::Error error = (*jit)->initialize((*jit)->getMainJITDylib())) {
+        return report_error(std::move(error));
+    }
+
+    llvm::Error error = llvm::Error::success();
+    uint64_t* program_num_locks = jit_address<uint64_t>(**jit, "num_locks", error);
+    uint8_t* program_unbuffered_output = jit_address<uint8_t>(**jit, "unbuffered_output", error);
+    uint8_t* program_allocator_backend = jit_address<uint8_t>(**jit, "coh_allocator_backend", error);
+    void (*program_initialize)() = jit_address<void()>(**jit, "coherence_initialize", error);
+    auto runtime_init = jit_address<decltype(coh_runtime_init)>(**jit, "coh_runtime_init", error);
+    auto runtime_start = jit_address<decltype(coh_runtime_start)>(**jit, "coh_runtime_start", error);
+    auto runtime_stop = jit_address<decltype(coh_runtime_stop)>(**jit, "coh_runtime_stop", error);
+    if(error) {
+        return report_error(std::move(error));
+    }
+    num_locks = *program_num_locks;
+    unbuffered_output = *program_unbuffered_output;
+    coh_allocator_backend = *program_allocator_backend;
+    jit_coherence_initialize = program_initialize;
+
+    // Same sequence as the [main] of the standalone runtime
+    runtime_init(nullptr);
+    runtime_start();
+    runtime_stop();
+    return 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <llvm/Support/MemoryBuffer.h>
+
+/*
+Runs a compiled program without writing or linking an executable. ORC's LLJIT links the objects of
+the program (see [emit_object_buffer]) in memory against the shared runtime at
+[runtime_library_path], which is loaded into the compiler process. Returns the exit status of the
+program.
+*/
+int run_in_jit(
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects,
+    const std::string& runtime_library_path);
@@ -0,0 +1,331 @@
+#include "llvm_backend.hpp"
+#include "parallel_for.hpp"
+#include <algorithm>
+#include <iostream>
+#include <unordered_set>
+#include <llvm/Analysis/AliasAnalysis.h>
+#include <llvm/Analysis/AliasSetTracker.h>
+#include <llvm/Analysis/LazyCallGraph.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Transforms/IPO/Internalize.h>
+#include <llvm/Transforms/Utils/LoopUtils.h>
+#include <llvm/Transforms/Utils/SplitModule.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/PassInstrumentation.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/SmallVectorMemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+
+void initialize_llvm_backend() {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    llvm::InitializeNativeTargetAsmParser();
+}
+
+std::unique_ptr<llvm::Module> parse_llvm_ir(llvm::LLVMContext& context, const std::string& llvm_ir) {
+    context.enableOpaquePointers();
+    llvm::SMDiagnostic diagnostic;
+    std::unique_ptr<llvm::Module> module = llvm::parseAssemblyString(llvm_ir, diagnostic, context);
+    if(!module) {
+        diagnostic.print("coherence", llvm::errs());
+        return nullptr;
+    }
+    if(llvm::verifyModule(*module, &llvm::errs())) {
+        std::cerr << "Error: generated IR does not verify" << std::endl;
+        return nullptr;
+    }
+    return module;
+}
+
+std::unique_ptr<llvm::TargetMachine> create_host_target_machine(bool optimize) {
+    std::string triple = llvm::sys::getDefaultTargetTriple();
+    std::string error;
+    const llvm::Target* target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if(!target) {
+        std::cerr << "Error: " << error << std::endl;
+        return nullptr;
+    }
+    llvm::TargetOptions target_options;
+    return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+        triple,
+        "generic",
+        "",
+        target_options,
+        llvm::Reloc::PIC_,
+        llvm::None,
+        optimize ? llvm::CodeGenOpt::Aggressive : llvm::CodeGenOpt::None));
+}
+
+// The generated IR is target independent, the passes need to know what they optimize for
+static void set_module_target(llvm::Module& module, llvm::TargetMachine& target_machine) {
+    module.setTargetTriple(target_machine.getTargetTriple().str());
+    module.setDataLayout(target_machine.createDataLayout());
+}
+
+// Some passes of LLVM 14 still read pointee types, which opaque pointers do not have, and crash.
+// ArgumentPromotion does so for every pointer parameter of an internal function, whether or not it
+// could promote it. Internal functions are the generated callables (see [infer_callable_attributes])
+// and, with LTO, everything but [main].
+static bool argument_promotion_crashes(const llvm::LazyCallGraph::SCC& scc) {
+    for(const llvm::LazyCallGraph::Node& node: scc) {
+        const llvm::Function& function = node.getFunction();
+        if(function.hasLocalLinkage() && std::any_of(function.arg_begin(), function.arg_end(), 
+            [](const llvm::Argument& arg) { return arg.getType()->isPointerTy(); })) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+LoopAccessAnalysis, which LoopVectorize and LoopLoadElimination use, does so for the accesses of a
+loop it prepares runtime alias checks for. Like the analysis, this looks at the alias sets of the
+innermost loops: checks are prepared for a set with a store and any other access. Loops that only
+store through pointers nothing else in the loop may alias, e.g. array elements next to member and
+message accesses (told apart by the TBAA tags of [tbaa_annotation]), need no checks.
+*/
+static std::vector<llvm::Loop*> loops_with_runtime_alias_checks(
+    llvm::LoopInfo& loop_info,
+    llvm::DominatorTree& dominator_tree,
+    llvm::AAResults& alias_analysis) {
+    std::vector<llvm::Loop*> checked_loops;
+    for(llvm::Loop* loop: loop_info.getLoopsInPreorder()) {
+        if(!loop->isInnermost()) {
+            continue;
+        }
+        llvm::BasicBlock* latch = loop->getLoopLatch();
+        llvm::AliasSetTracker alias_sets(alias_analysis);
+        std::unordered_set<const llvm::Value*> stored;
+        for(llvm::BasicBlock* block: loop->blocks()) {
+            // The analysis drops the TBAA tags of accesses that do not happen on every iteration
+            bool conditional = latch == nullptr || !dominator_tree.dominates(block, latch);
+            for(llvm::Instruction& instruction: *block) {
+                llvm::Value* pointer = llvm::getLoadStorePointerOperand(&instruction);
+                if(pointer == nullptr) {
+                    continue;
+                }
+                llvm::AAMDNodes tags = instruction.getAAMetadata();
+                if(conditional) {
+                    tags.TBAA = nullptr;
+                }
+                alias_sets.add(pointer, llvm::LocationSize::beforeOrAfterPointer(), tags);
+                if(llvm::isa<llvm::StoreInst>(instruction)) {
+                    stored.insert(pointer);
+                }
+            }
+        }
+        for(const llvm::AliasSet& alias_set: alias_sets) {
+            if(alias_set.isForwardingAliasSet()) {
+                continue;
+            }
+            size_t stored_pointers = 0;
+            size_t loaded_pointers = 0;
+            for(const auto& pointer: alias_set) {
+                (stored.contains(pointer.getValue()) ? stored_pointers : loaded_pointers)++;
+            }
+            if(stored_pointers > 1 || (stored_pointers == 1 && loaded_pointers > 0)) {
+                checked_loops.push_back(loop);
+                break;
+            }
+        }
+    }
+    return checked_loops;
+}
+
+void optimize_module(llvm::Module& module, llvm::TargetMachine& target_machine, OptimizationStage stage) {
+    set_module_target(module, target_machine);
+    llvm::LoopAnalysisManager loop_analyses;
+    llvm::FunctionAnalysisManager function_analyses;
+    llvm::CGSCCAnalysisManager cgscc_analyses;
+    llvm::ModuleAnalysisManager module_analyses;
+    llvm::PassInstrumentationCallbacks instrumentation;
+    instrumentation.registerShouldRunOptionalPassCallback([&](llvm::StringRef pass, llvm::Any ir) {
+        if(pass == "ArgumentPromotionPass") {
+            return !argument_promotion_crashes(*llvm::any_cast<const llvm::LazyCallGraph::SCC*>(ir));
+        }
+        if(pass == "LoopVectorizePass" || pass == "LoopLoadEliminationPass") {
+            auto& function = const_cast<llvm::Function&>(*llvm::any_cast<const llvm::Function*>(ir));
+            std::vector<llvm::Loop*> checked_loops = loops_with_runtime_alias_checks(
+                function_analyses.getResult<llvm::LoopAnalysis>(function),
+                function_analyses.getResult<llvm::DominatorTreeAnalysis>(function),
+                function_analyses.getResult<llvm::AAManager>(function));
+            if(pass == "LoopLoadEliminationPass") {
+                return checked_loops.empty();
+            }
+            // LoopVectorize reads the hints of a loop before analyzing it, and leaves the loop alone
+            for(llvm::Loop* loop: checked_loops) {
+                llvm::addStringMetadataToLoop(loop, "llvm.loop.vectorize.enable", 0);
+            }
+            return true;
+        }
+        return true;
+    });
+    llvm::PassBuilder pass_builder(&target_machine, llvm::PipelineTuningOptions(), llvm::None, &instrumentation);
+    pass_builder.registerModuleAnalyses(module_analyses);
+    pass_builder.registerCGSCCAnalyses(cgscc_analyses);
+    pass_builder.registerFunctionAnalyses(function_analyses);
+    pass_builder.registerLoopAnalyses(loop_analyses);
+    pass_builder.crossRegisterProxies(loop_analyses, function_analyses, cgscc_analyses, module_analyses);
+    llvm::ModulePassManager pipeline;
+    switch(stage) {
+        case OptimizationStage::COMPLETE:
+            pipeline = pass_builder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O3);
+            break;
+        case OptimizationStage::LTO_PRE_LINK:
+            pipeline = pass_builder.buildLTOPreLinkDefaultPipeline(llvm::OptimizationLevel::O3);
+            break;
+        case OptimizationStage::LTO:
+            pipeline = pass_builder.buildLTODefaultPipeline(llvm::OptimizationLevel::O3, nullptr);
+            break;
+    }
+    pipeline.run(module, module_analyses);
+}
+
+std::unique_ptr<llvm::MemoryBuffer> write_bitcode_buffer(const llvm::Module& module) {
+    llvm::SmallVector<char, 0> bitcode;
+    llvm::raw_svector_ostream out(bitcode);
+    llvm::WriteBitcodeToFile(module, out);
+    return std::make_unique<llvm::SmallVectorMemoryBuffer>(std::move(bitcode), module.getModuleIdentifier());
+}
+
+/*
+A behaviour can suspend in a trap (e.g. [handle_lock]) and resume on another worker thread, but
+LLVM takes the address of a thread_local to be the same throughout a function, and may reuse one
+computed before the suspend. Every runtime function that accesses a thread_local therefore stays a
+call, so the access computes the address of the worker the code runs on at that point.
+*/
+static void keep_thread_local_accesses_out_of_line(llvm::Module& module) {
+    std::vector<llvm::User*> users;
+    for(llvm::GlobalVariable& global: module.globals()) {
+        if(global.isThreadLocal()) {
+            users.insert(users.end(), global.user_begin(), global.user_end());
+        }
+    }
+    while(!users.empty()) {
+        llvm::User* user = users.back();
+        users.pop_back();
+        if(auto* instruction = llvm::dyn_cast<llvm::Instruction>(user)) {
+            llvm::Function* function = instruction->getFunction();
+            function->removeFnAttr(llvm::Attribute::AlwaysInline);
+            function->addFnAttr(llvm::Attribute::NoInline);
+        }
+        else if(llvm::isa<llvm::ConstantExpr>(user)) {
+            // e.g. a getelementptr into the thread_local
+            users.insert(users.end(), user->user_begin(), user->user_end());
+        }
+    }
+}
+
+std::unique_ptr<llvm::Module> link_lto_module(
+    llvm::LLVMContext& context,
+    const std::vector<std::unique_ptr<llvm::MemoryBuffer>>& modules,
+    const std::string& runtime_bitcode_path) {
+    context.enableOpaquePointers();
+    llvm::SMDiagnostic diagnostic;
+    std::unique_ptr<llvm::Module> linked_module = llvm::parseIRFile(runtime_bitcode_path, diagnostic, context);
+    if(!linked_module) {
+        diagnostic.print("coherence", llvm::errs());
+        return nullptr;
+    }
+    llvm::Linker linker(*linked_module);
+    for(const std::unique_ptr<llvm::MemoryBuffer>& module_bitcode: modules) {
+        llvm::Expected<std::unique_ptr<llvm::Module>> module = 
+            llvm::parseBitcodeFile(module_bitcode->getMemBufferRef(), context);
+        if(!module) {
+            std::cerr << "Error: " << llvm::toString(module.takeError()) << std::endl;
+            return nullptr;
+        }
+        // The runtime sets the target, the generated modules do not
+        (*module)->setTargetTriple(linked_module->getTargetTriple());
+        (*module)->setDataLayout(linked_module->getDataLayout());
+        if(linker.linkInModule(std::move(*module))) {
+            std::cerr << "Error: could not link the program with the runtime" << std::endl;
+            return nullptr;
+        }
+    }
+    keep_thread_local_accesses_out_of_line(*linked_module);
+    llvm::internalizeModule(*linked_module, [](const llvm::GlobalValue& global_value) {
+        return global_value.getName() == "main";
+    });
+    return linked_module;
+}
+
+// Runs the code generator of [target_machine] over [module], writing the object to [out]
+static bool generate_object(llvm::Module& module, llvm::TargetMachine& target_machine, llvm::raw_pwrite_stream& out) {
+    set_module_target(module, target_machine);
+    llvm::legacy::PassManager code_generator;
+    if(target_machine.addPassesToEmitFile(code_generator, out, nullptr, llvm::CGFT_ObjectFile)) {
+        std::cerr << "Error: the target can not emit object files" << std::endl;
+        return false;
+    }
+    code_generator.run(module);
+    return true;
+}
+
+bool emit_object_file(llvm::Module& module, llvm::TargetMachine& target_machine, const std::string& path) {
+    std::error_code error;
+    llvm::raw_fd_ostream out(path, error, llvm::sys::fs::OF_None);
+    if(error) {
+        std::cerr << "Error: could not open " << path << ": " << error.message() << std::endl;
+        return false;
+    }
+    return generate_object(module, target_machine, out);
+}
+
+bool emit_split_object_files(
+    llvm::Module& module, 
+    llvm::TargetMachine& target_machine, 
+    bool optimize,
+    const std::vector<std::string>& paths) {
+    set_module_target(module, target_machine);
+    // The parts share the context of [module], so they move to contexts of their own as bitcode
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> parts;
+    llvm::SplitModule(module, paths.size(), [&](std::unique_ptr<llvm::Module> part) {
+        parts.push_back(write_bitcode_buffer(*part));
+    });
+    std::vector<char> part_ok(parts.size(), false);
+    parallel_for(parts.size(), parts.size(), [&](size_t i) {
+        llvm::LLVMContext context;
+        context.enableOpaquePointers();
+        llvm::Expected<std::unique_ptr<llvm::Module>> part = 
+            llvm::parseBitcodeFile(parts[i]->getMemBufferRef(), context);
+        if(!part) {
+            std::cerr << "Error: " << llvm::toString(part.takeError()) << std::endl;
+            return;
+        }
+        std::unique_ptr<llvm::TargetMachine> part_target_machine = create_host_target_machine(optimize);
+        part_ok[i] = part_target_machine && emit_object_file(**part, *part_target_machine, paths[i]);
+    });
+    return std::find(part_ok.begin(), part_ok.end(), false) == part_ok.end();
+}
+
+std::unique_ptr<llvm::MemoryBuffer> emit_object_buffer(llvm::Module& module, llvm::TargetMachine& target_machine) {
+    llvm::SmallVector<char, 0> object;
+    llvm::raw_svector_ostream out(object);
+    if(!generate_object(module, target_machine, out)) {
+        return nullptr;
+    }
+    return std::make_unique<llvm::SmallVectorMemoryBuffer>(std::move(object), module.getModuleIdentifier());
+}
+
+bool write_llvm_ir(const llvm::Module& module, const std::string& path) {
+    std::error_code error;
+    llvm::raw_fd_ostream out(path, error, llvm::sys::fs::OF_Text);
+    if(error) {
+        std::cerr << "Error: could not open " << path << ": " << error.message() << std::endl;
+        return false;
+    }
+    module.print(out, nullptr);
+    return true;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Target/TargetMachine.h>
+
+/*
+Turns the IR produced by [ast_codegen] into machine code inside the compiler process. The IR is
+parsed once, and the optimizer and the code generator work on the in-memory module, instead of
+each tool re-parsing a file written by the previous one.
+
+This covers optimization and code generation only. Codegen still writes textual IR rather than
+building the module with IRBuilder, and executables are still linked by the system clang++ rather
+than by LLD as a library; moving those two steps in-process is a separate piece of work.
+*/
+
+// Sets up the host target. Must be called before anything else in this file.
+void initialize_llvm_backend();
+
+// Parses [llvm_ir] into a module owned by [context], which must not have been used yet (the IR
+// uses opaque pointers). Reports errors on std::cerr and returns null if the IR is malformed.
+std::unique_ptr<llvm::Module> parse_llvm_ir(llvm::LLVMContext& context, const std::string& llvm_ir);
+
+// Target machine for the host. The code it generates is position independent, so the same object
+// can be linked into an executable or into a host program.
+std::unique_ptr<llvm::TargetMachine> create_host_target_machine(bool optimize);
+
+enum class OptimizationStage {
+    // The module is the whole program
+    COMPLETE,
+    // The module is linked with others (see [link_lto_module]) and optimized again afterwards
+    LTO_PRE_LINK,
+    // The module is the result of [link_lto_module]
+    LTO
+};
+
+// Runs the -O3 pipeline of [stage] over [module]
+void optimize_module(
+    llvm::Module& module, 
+    llvm::TargetMachine& target_machine, 
+    OptimizationStage stage = OptimizationStage::COMPLETE);
+
+// Serializes [module] as bitcode, to move it to another context
+std::unique_ptr<llvm::MemoryBuffer> write_bitcode_buffer(const llvm::Module& module);
+
+/*
+Links the bitcode [modules] and the bitcode file at [runtime_bitcode_path] into one module owned by
+[context]. Only [main] stays visible outside the module, so the optimizer is free to inline, specialize
+or drop everything else, runtime included, except for the runtime functions that access thread_locals:
+these are never inlined. Reports errors on std::cerr and returns null on failure.
+*/
+std::unique_ptr<llvm::Module> link_lto_module(
+    llvm::LLVMContext& context,
+    const std::vector<std::unique_ptr<llvm::MemoryBuffer>>& modules,
+    const std::string& runtime_bitcode_path);
+
+// Writes [module] to [path] as an object file. Returns false on failure.
+bool emit_object_file(llvm::Module& module, llvm::TargetMachine& target_machine, const std::string& path);
+
+// Splits [module] and generates the parts in parallel, one object file per path of [paths]. Linked
+// together, the objects are equivalent to the object of the whole module. Returns false on failure.
+bool emit_split_object_files(
+    llvm::Module& module, 
+    llvm::TargetMachine& target_machine, 
+    bool optimize,
+    const std::vector<std::string>& paths);
+
+// Same as [emit_object_file], but the object stays in memory. Returns null on failure.
+std::unique_ptr<llvm::MemoryBuffer> emit_object_buffer(llvm::Module& module, llvm::TargetMachine& target_machine);
+
+// Writes [module] to [path] as textual IR (a debugging aid). Returns false on failure.
+bool write_llvm_ir(const llvm::Module& module, const std::string& path);
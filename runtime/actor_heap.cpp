@@ -0,0 +1,153 @@
+#include "runtime_traps.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// Every block is preceded by the chunk it belongs to, or nullptr for large blocks
+using BlockHeader = HeapChunk*;
+
+static constexpr uint64_t MIN_CHUNK_CAPACITY = 256;
+static constexpr uint64_t MAX_CHUNK_CAPACITY = 64 * 1024;
+// Larger blocks (usually arrays) are malloc'd directly, so they do not pin a chunk
+static constexpr uint64_t MAX_CHUNK_BLOCK_SIZE = 4 * 1024;
+
+// Heap for allocations made while no actor is running (e.g. by an embedding host)
+static thread_local ActorHeap thread_heap;
+
+static void release_chunk_block(HeapChunk* chunk) {
+    if(--(chunk->live_blocks) == 0) {
+        chunk->~HeapChunk();
+        std::free(chunk);
+    }
+}
+
+ActorHeap::ActorHeap(): next_chunk_capacity(MIN_CHUNK_CAPACITY) {}
+
+ActorHeap::~ActorHeap() {
+    retire_current_chunk();
+}
+
+void ActorHeap::retire_current_chunk() {
+    if(current_chunk != nullptr) {
+        release_chunk_block(current_chunk);
+        current_chunk = nullptr;
+    }
+}
+
+void* ActorHeap::allocate(uint64_t size) {
+    // Blocks are 8 byte aligned, which is enough for every type the compiler emits
+    uint64_t block_size = (size + sizeof(BlockHeader) + 7) & ~uint64_t(7);
+    if(block_size > MAX_CHUNK_BLOCK_SIZE) {
+        BlockHeader* header = static_cast<BlockHeader*>(std::malloc(block_size));
+        *header = nullptr;
+        return header + 1;
+    }
+    if(current_chunk == nullptr || current_chunk->used + block_size > current_chunk->capacity) {
+        if(current_chunk != nullptr && current_chunk->live_blocks == 1 && 
+            block_size <= current_chunk->capacity) {
+            // Every block was freed (only our own count is left), so nobody else can touch the
+            // chunk and it can be reused from the start
+            current_chunk->used = 0;
+        }
+        else {
+            retire_current_chunk();
+            uint64_t capacity = std::max(next_chunk_capacity, block_size);
+            next_chunk_capacity = std::min(2 * next_chunk_capacity, MAX_CHUNK_CAPACITY);
+            current_chunk = new (std::malloc(sizeof(HeapChunk) + capacity)) HeapChunk;
+            current_chunk->live_blocks = 1;
+            current_chunk->capacity = capacity;
+            current_chunk->used = 0;
+        }
+    }
+    char* block = reinterpret_cast<char*>(current_chunk + 1) + current_chunk->used;
+    current_chunk->used += block_size;
+    current_chunk->live_blocks++;
+    BlockHeader* header = reinterpret_cast<BlockHeader*>(block);
+    *header = current_chunk;
+    return header + 1;
+}
+
+void* ActorHeap::allocate_zeroed(uint64_t size) {
+    uint64_t block_size = (size + sizeof(BlockHeader) + 7) & ~uint64_t(7);
+    if(block_size > MAX_CHUNK_BLOCK_SIZE) {
+        // Fresh pages from the OS are already zero, which calloc knows to take advantage of
+        BlockHeader* header = static_cast<BlockHeader*>(std::calloc(1, block_size));
+        *header = nullptr;
+        return header + 1;
+    }
+    void* block = allocate(size);
+    std::memset(block, 0, size);
+    return block;
+}
+
+void ActorHeap::free(void* block) {
+    if(block == nullptr) {
+        return;
+    }
+    BlockHeader* header = static_cast<BlockHeader*>(block) - 1;
+    if(*header == nullptr) {
+        std::free(header);
+        return;
+    }
+    release_chunk_block(*header);
+}
+
+static constexpr uint64_t MIN_ARENA_CHUNK_CAPACITY = 4 * 1024;
+// A behaviour that needed more than this keeps none of it after it returns
+static constexpr uint64_t MAX_RETAINED_ARENA_CAPACITY = 1024 * 1024;
+
+static void free_arena_chunks(ArenaChunk* chunk) {
+    while(chunk != nullptr) {
+        ArenaChunk* next = chunk->next;
+        std::free(chunk);
+        chunk = next;
+    }
+}
+
+BehaviourArena::~BehaviourArena() {
+    free_arena_chunks(chunks);
+}
+
+void* BehaviourArena::allocate(uint64_t size) {
+    uint64_t block_size = (size + 7) & ~uint64_t(7);
+    if(chunks == nullptr || used + block_size > chunks->capacity) {
+        uint64_t capacity = chunks == nullptr ? MIN_ARENA_CHUNK_CAPACITY : 2 * chunks->capacity;
+        capacity = std::max(capacity, block_size);
+        ArenaChunk* chunk = static_cast<ArenaChunk*>(std::malloc(sizeof(ArenaChunk) + capacity));
+        chunk->next = chunks;
+        chunk->capacity = capacity;
+        chunks = chunk;
+        used = 0;
+    }
+    void* block = reinterpret_cast<char*>(chunks + 1) + used;
+    used += block_size;
+    return block;
+}
+
+void BehaviourArena::reset() {
+    if(chunks == nullptr) {
+        return;
+    }
+    // Keep the newest chunk, which is also the largest, unless it is too large to hold on to
+    free_arena_chunks(chunks->next);
+    chunks->next = nullptr;
+    if(chunks->capacity > MAX_RETAINED_ARENA_CAPACITY) {
+        std::free(chunks);
+        chunks = nullptr;
+    }
+    used = 0;
+}
+
+void* coh_arena_alloc(uint64_t size) {
+    if(running_instance == nullptr) {
+        // Outside any behaviour (e.g. the constructor of [Main] run by an embedding host) there
+        // is no point at which the arena could be reset
+        return thread_heap.allocate(size);
+    }
+    return running_instance->arena.allocate(size);
+}
+
+ActorHeap& ActorHeap::current() {
+    return running_instance != nullptr ? running_instance->heap : thread_heap;
+}
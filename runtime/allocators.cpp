@@ -0,0 +1,241 @@
+#include "runtime_traps.hpp"
+#include <array>
+#include <cstdlib>
+#include <cstring>
+
+// Emitted by the generated code
+extern "C" uint8_t coh_allocator_backend;
+
+// Every backend hands out 8 byte aligned blocks, which is enough for every type the compiler emits
+static uint64_t round_up_8(uint64_t size) {
+    return (size + 7) & ~uint64_t(7);
+}
+
+/*
+Size-class allocator. Blocks are carved out of spans and rounded up to one of [SIZE_CLASSES]; the
+8 bytes before a block hold its class. Every thread caches free blocks per class, so the common
+case of allocating and freeing takes no locks. Caches exchange blocks in batches with shared free
+lists when they run empty or grow too long, which keeps the memory freed by a thread other than
+the one that allocated it (e.g. messages) in circulation. Spans are never returned to the OS.
+*/
+namespace size_class {
+
+static constexpr uint64_t SIZE_CLASSES[] = {
+    16, 32, 48, 64, 80, 96, 128, 160, 192, 256, 320, 384, 512, 768, 1024, 1536, 2048, 3072, 4096
+};
+static constexpr uint64_t NUM_CLASSES = sizeof(SIZE_CLASSES) / sizeof(SIZE_CLASSES[0]);
+static constexpr uint64_t MAX_CLASS_SIZE = SIZE_CLASSES[NUM_CLASSES - 1];
+// Class of the blocks malloc'd directly
+static constexpr uint64_t LARGE_CLASS = NUM_CLASSES;
+static constexpr uint64_t SPAN_SIZE = 64 * 1024;
+// Number of blocks a thread cache takes from or gives to a shared list at once
+static constexpr uint64_t TRANSFER_BATCH = 32;
+
+using BlockHeader = uint64_t;
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+struct SharedFreeList {
+    RuntimeMutex lock;
+    FreeBlock* head = nullptr;
+};
+static SharedFreeList shared_lists[NUM_CLASSES];
+
+struct ThreadCache {
+    FreeBlock* heads[NUM_CLASSES];
+    uint64_t lengths[NUM_CLASSES];
+    // Set once the thread exits, after which frees go straight to the shared lists
+    bool flushed;
+};
+// Trivially destructible, so it stays usable by the destructors of other thread locals
+static thread_local ThreadCache thread_cache;
+
+// [class_of_size[(size + 15) / 16]] is the smallest class holding [size] bytes (header included)
+static constexpr auto class_of_size = [] {
+    std::array<uint8_t, MAX_CLASS_SIZE / 16 + 1> table{};
+    uint64_t cls = 0;
+    for(uint64_t i = 0; i < table.size(); i++) {
+        while(SIZE_CLASSES[cls] < i * 16) {
+            cls++;
+        }
+        table[i] = cls;
+    }
+    return table;
+}();
+
+// Moves the first [count] blocks of the thread cache of [cls] to the shared list
+static void give_back(uint64_t cls, uint64_t count) {
+    FreeBlock* first = thread_cache.heads[cls];
+    FreeBlock* last = first;
+    for(uint64_t i = 1; i < count; i++) {
+        last = last->next;
+    }
+    thread_cache.heads[cls] = last->next;
+    thread_cache.lengths[cls] -= count;
+    std::lock_guard<RuntimeMutex> guard(shared_lists[cls].lock);
+    last->next = shared_lists[cls].head;
+    shared_lists[cls].head = first;
+}
+
+struct ThreadCacheFlusher {
+    ~ThreadCacheFlusher() {
+        for(uint64_t cls = 0; cls < NUM_CLASSES; cls++) {
+            if(thread_cache.lengths[cls] != 0) {
+                give_back(cls, thread_cache.lengths[cls]);
+            }
+        }
+        thread_cache.flushed = true;
+    }
+};
+static thread_local ThreadCacheFlusher thread_cache_flusher;
+
+static void refill(uint64_t cls) {
+    // Makes sure the cache is flushed when the thread exits
+    (void)&thread_cache_flusher;
+    {
+        std::lock_guard<RuntimeMutex> guard(shared_lists[cls].lock);
+        FreeBlock* head = shared_lists[cls].head;
+        uint64_t taken = 0;
+        FreeBlock* last = nullptr;
+        for(FreeBlock* block = head; block != nullptr && taken < TRANSFER_BATCH; block = block->next) {
+            last = block;
+            taken++;
+        }
+        if(taken != 0) {
+            shared_lists[cls].head = last->next;
+            last->next = thread_cache.heads[cls];
+            thread_cache.heads[cls] = head;
+            thread_cache.lengths[cls] += taken;
+            return;
+        }
+    }
+    uint64_t block_size = SIZE_CLASSES[cls];
+    char* span = static_cast<char*>(std::malloc(SPAN_SIZE));
+    for(uint64_t offset = 0; offset + block_size <= SPAN_SIZE; offset += block_size) {
+        FreeBlock* block = reinterpret_cast<FreeBlock*>(span + offset);
+        block->next = thread_cache.heads[cls];
+        thread_cache.heads[cls] = block;
+        thread_cache.lengths[cls]++;
+    }
+}
+
+static void* allocate(uint64_t size, bool zeroed) {
+    uint64_t total = round_up_8(size) + sizeof(BlockHeader);
+    if(total > MAX_CLASS_SIZE) {
+        void* memory = zeroed ? std::calloc(1, total) : std::malloc(total);
+        BlockHeader* header = static_cast<BlockHeader*>(memory);
+        *header = LARGE_CLASS;
+        return header + 1;
+    }
+    uint64_t cls = class_of_size[(total + 15) / 16];
+    if(thread_cache.heads[cls] == nullptr) {
+        refill(cls);
+    }
+    FreeBlock* block = thread_cache.heads[cls];
+    thread_cache.heads[cls] = block->next;
+    thread_cache.lengths[cls]--;
+    BlockHeader* header = reinterpret_cast<BlockHeader*>(block);
+    *header = cls;
+    if(zeroed) {
+        std::memset(header + 1, 0, size);
+    }
+    return header + 1;
+}
+
+static void free(void* block) {
+    BlockHeader* header = static_cast<BlockHeader*>(block) - 1;
+    uint64_t cls = *header;
+    if(cls == LARGE_CLASS) {
+        std::free(header);
+        return;
+    }
+    FreeBlock* free_block = reinterpret_cast<FreeBlock*>(header);
+    free_block->next = thread_cache.heads[cls];
+    thread_cache.heads[cls] = free_block;
+    thread_cache.lengths[cls]++;
+    if(thread_cache.flushed) {
+        give_back(cls, thread_cache.lengths[cls]);
+    }
+    else if(thread_cache.lengths[cls] > 2 * TRANSFER_BATCH) {
+        give_back(cls, TRANSFER_BATCH);
+    }
+}
+
+}
+
+// Bump allocator for benchmarks: one chunk per thread, and memory is never reused
+namespace bump {
+
+static constexpr uint64_t CHUNK_SIZE = 1024 * 1024;
+
+struct BumpChunk {
+    char* next = nullptr;
+    char* end = nullptr;
+};
+static thread_local BumpChunk thread_chunk;
+
+static void* allocate(uint64_t size) {
+    uint64_t block_size = round_up_8(size);
+    if(block_size > CHUNK_SIZE / 4) {
+        return std::malloc(block_size);
+    }
+    if(thread_chunk.next == nullptr || thread_chunk.next + block_size > thread_chunk.end) {
+        thread_chunk.next = static_cast<char*>(std::malloc(CHUNK_SIZE));
+        thread_chunk.end = thread_chunk.next + CHUNK_SIZE;
+    }
+    void* block = thread_chunk.next;
+    thread_chunk.next += block_size;
+    return block;
+}
+
+}
+
+void* coh_alloc(uint64_t size) {
+    switch(static_cast<AllocatorBackend>(coh_allocator_backend)) {
+        case AllocatorBackend::LIBC:
+            return std::malloc(size);
+        case AllocatorBackend::SIZE_CLASS:
+            return size_class::allocate(size, false);
+        case AllocatorBackend::BUMP:
+            return bump::allocate(size);
+        default:
+            return ActorHeap::current().allocate(size);
+    }
+}
+
+void* coh_alloc_zeroed(uint64_t size) {
+    switch(static_cast<AllocatorBackend>(coh_allocator_backend)) {
+        case AllocatorBackend::LIBC:
+            return std::calloc(1, size);
+        case AllocatorBackend::SIZE_CLASS:
+            return size_class::allocate(size, true);
+        case AllocatorBackend::BUMP: {
+            void* block = bump::allocate(size);
+            std::memset(block, 0, size);
+            return block;
+        }
+        default:
+            return ActorHeap::current().allocate_zeroed(size);
+    }
+}
+
+void coh_free(void* block) {
+    if(block == nullptr) {
+        return;
+    }
+    switch(static_cast<AllocatorBackend>(coh_allocator_backend)) {
+        case AllocatorBackend::LIBC:
+            std::free(block);
+            return;
+        case AllocatorBackend::SIZE_CLASS:
+            size_class::free(block);
+            return;
+        case AllocatorBackend::BUMP:
+            return;
+        default:
+            ActorHeap::free(block);
+            return;
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+/*
+Public API for hosting Coherence actors inside another process. The compiled Coherence program
+(emitted with --emit-object) is linked together with the [coherence_embed] library, and the host
+drives the runtime through these calls instead of the [main] provided by the standalone runtime.
+
+Typical use:
+    CohRuntimeConfig config{.num_workers = 4};
+    coh_runtime_init(&config);
+    coh_runtime_start();
+    coh_runtime_send(coh_runtime_main_actor(), message, behaviour_fn);
+    coh_runtime_wait_quiescent();
+    coh_runtime_stop();
+*/
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct CohRuntimeConfig {
+    // Number of worker threads. 0 picks the default. Ignored by the single-threaded runtime
+    uint32_t num_workers;
+} CohRuntimeConfig;
+
+// Sets up the runtime and runs the constructor of the [Main] actor on the calling thread.
+// Messages sent by the constructor are queued until [coh_runtime_start] is called.
+void coh_runtime_init(const CohRuntimeConfig* config);
+
+// Spawns the worker threads. With the single-threaded runtime this is a no-op and messages are
+// processed by [coh_runtime_wait_quiescent] on the calling thread instead.
+void coh_runtime_start(void);
+
+// Instance id of the [Main] actor created by [coh_runtime_init]
+uint64_t coh_runtime_main_actor(void);
+
+// Allocator used for everything the generated code frees, including messages. Blocks are 8 byte
+// aligned, and can be freed from any thread.
+void* coh_alloc(uint64_t size);
+void coh_free(void* block);
+
+/*
+Enqueues a behaviour call on [instance_id]. [message] is the behaviour's argument struct
+(<be>.<Actor>.be.struct), allocated with [coh_alloc], whose last field is the i64 id of the
+receiver. The parameters before it may be reordered (see codegen/CONVENTIONS.md), so hosts take the
+message structs of [Main] from the out.h the compiler writes next to out.o with --emit-object.
+[behaviour_fn] is the behaviour itself (<be>.<Actor>.be), which the runtime looks up among the
+behaviours of the receiver and calls with the message and the receiver's actor struct. Ownership
+of [message] passes to the runtime, and the behaviour frees it when it finishes. Safe to call from
+any host thread, except with the single-threaded runtime, where it must be called from the thread
+that drives the runtime.
+*/
+void coh_runtime_send(uint64_t instance_id, void* message, void (*behaviour_fn)(void*, void*));
+
+/*
+Index of [behaviour_fn] among the behaviours of the receiver, or -1 if it is not one of them. It is
+the same for every instance of an actor, so a host that sends often resolves it once and calls
+[coh_runtime_send_indexed], which saves [coh_runtime_send] searching the behaviours on every call.
+*/
+int64_t coh_runtime_behaviour_index(uint64_t instance_id, void (*behaviour_fn)(void*, void*));
+
+// [coh_runtime_send] with the behaviour given by its index. Both abort with a message if the
+// receiver has no such behaviour.
+void coh_runtime_send_indexed(uint64_t instance_id, void* message, int64_t behaviour_index);
+
+/*
+Actors are freed once nothing references them. The behaviour releases the actor ids stored in its
+message when it finishes, so every actor id a host puts in a message must be retained first.
+[Main] is never freed, so the host does not need to retain it to send to it.
+*/
+void coh_runtime_retain_actor(uint64_t instance_id);
+void coh_runtime_release_actor(uint64_t instance_id);
+
+// Blocks until the schedule queue is empty and every worker is idle
+void coh_runtime_wait_quiescent(void);
+
+// Waits for quiescence and joins the worker threads. The runtime can not be restarted.
+void coh_runtime_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,60 @@
+#include "output_buffer.hpp"
+#include "runtime_datastructures.hpp"
+#include <charconv>
+#include <cstdio>
+#include <string>
+
+// Set by the generated code (--unbuffered-output). Every integer is then written and flushed
+// immediately, which helps when debugging a program that crashes.
+extern "C" uint8_t unbuffered_output;
+
+// A worker publishes early if a single behaviour prints a lot
+static constexpr size_t WORKER_PUBLISH_THRESHOLD = 16 * 1024;
+// The shared buffer is written out once it reaches this size
+static constexpr size_t SHARED_FLUSH_THRESHOLD = 256 * 1024;
+
+static thread_local std::string worker_output;
+static RuntimeMutex shared_output_lock;
+static std::string shared_output;
+
+static void write_shared_output() {
+    std::fwrite(shared_output.data(), 1, shared_output.size(), stdout);
+    std::fflush(stdout);
+    shared_output.clear();
+}
+
+void buffer_int_output(int i) {
+    char formatted[16];
+    auto [end, ec] = std::to_chars(formatted, formatted + sizeof(formatted) - 1, i);
+    *end++ = '\n';
+    if(unbuffered_output) {
+        std::lock_guard<RuntimeMutex> output_guard(shared_output_lock);
+        shared_output.append(formatted, end);
+        write_shared_output();
+        return;
+    }
+    worker_output.append(formatted, end);
+    if(worker_output.size() >= WORKER_PUBLISH_THRESHOLD) {
+        publish_output();
+    }
+}
+
+void publish_output() {
+    if(worker_output.empty()) {
+        return;
+    }
+    std::lock_guard<RuntimeMutex> output_guard(shared_output_lock);
+    shared_output.append(worker_output);
+    worker_output.clear();
+    if(shared_output.size() >= SHARED_FLUSH_THRESHOLD) {
+        write_shared_output();
+    }
+}
+
+void flush_output() {
+    publish_output();
+    std::lock_guard<RuntimeMutex> output_guard(shared_output_lock);
+    if(!shared_output.empty()) {
+        write_shared_output();
+    }
+}
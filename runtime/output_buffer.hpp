@@ -0,0 +1,18 @@
+#pragma once
+/*
+Output produced by OUT is appended to a buffer owned by the worker thread, without locking.
+The buffer is published to the shared output buffer whenever the running behaviour could become
+observable to another actor: when it sends a message, releases a lock or suspends. That keeps
+the output in happens-before order (in particular, in order per actor, even if the actor moves
+between workers). The shared buffer is written to stdout in large chunks, and when the runtime
+reaches quiescence or stops.
+*/
+
+// Appends [i] to the output of the current worker thread
+void buffer_int_output(int i);
+
+// Moves the output of the current worker thread to the shared output buffer
+void publish_output();
+
+// Writes the shared output buffer to stdout
+void flush_output();
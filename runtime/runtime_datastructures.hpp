@@ -3,51 +3,211 @@
 #include <unordered_map>
 #include <memory>
 #include <deque>
+#include <vector>
 #include <mutex>
 #include <optional>
 #include <atomic>
 #include <assert.h>
 #include <semaphore>
 #include <condition_variable>
+#include <chrono>
 #include <boost/context/detail/fcontext.hpp>
+#include "timer_wheel.hpp"
 
 namespace boost_ctx = boost::context::detail;
 
 struct RuntimeDS;
+struct ActorInstanceState;
+
+#ifdef COH_SINGLE_THREADED
+// With a single worker nothing in the runtime runs concurrently, so the synchronisation
+// primitives compile down to nothing and instances are handed around as raw pointers.
+struct RuntimeMutex {
+    void lock() {}
+    void unlock() {}
+};
+struct RuntimeCondVar {
+    void notify_one() {}
+    void notify_all() {}
+    // The only worker never waits: an empty schedule queue means the program is done
+    template <typename Lock>
+    void wait(Lock&) { assert(false); }
+};
+template <typename T>
+using RuntimeAtomic = T;
+using ActorInstanceRef = ActorInstanceState*;
+#else
+using RuntimeMutex = std::mutex;
+using RuntimeCondVar = std::condition_variable;
+template <typename T>
+using RuntimeAtomic = std::atomic<T>;
+using ActorInstanceRef = std::shared_ptr<ActorInstanceState>;
+#endif
+
+/*
+Memory handed out to generated code by [coh_alloc] with the default allocator backend (see
+[AllocatorBackend]). Each actor instance owns a heap, which serves the allocations made while the
+actor runs; threads own one for allocations made outside any actor. A heap bump-allocates from
+chunks only it allocates from, so allocation takes no locks. Blocks can be freed from any thread: a
+chunk counts its live blocks, plus one while it is the heap's current chunk, and is freed by whoever
+drops the count to 0. When an actor is reclaimed its heap retires the current chunk, so the actor's
+memory is returned in bulk once the blocks it handed out (messages, arrays) are freed. Large blocks
+bypass the heaps.
+*/
+struct HeapChunk {
+    RuntimeAtomic<uint64_t> live_blocks;
+    uint64_t capacity;
+    uint64_t used;
+    // [capacity] bytes of blocks follow
+};
+
+class ActorHeap {
+private:
+    HeapChunk* current_chunk = nullptr;
+    // Chunks grow geometrically, so actors that barely allocate stay small
+    uint64_t next_chunk_capacity;
+    void retire_current_chunk();
+
+public:
+    ActorHeap();
+    ActorHeap(const ActorHeap&) = delete;
+    ActorHeap& operator=(const ActorHeap&) = delete;
+    ~ActorHeap();
+    void* allocate(uint64_t size);
+    void* allocate_zeroed(uint64_t size);
+    // Frees a block allocated by any heap
+    static void free(void* block);
+    // The heap of the running instance, or of the calling thread outside any actor
+    static ActorHeap& current();
+};
+
+/*
+Memory for the [new] expressions that escape analysis proved can not outlive the behaviour
+allocating them. Blocks are bump-allocated from a list of chunks and never freed one by one:
+the whole arena is reset when the behaviour returns to the scheduler. Only the instance that owns
+the arena allocates from it, and only while it runs.
+*/
+struct ArenaChunk {
+    ArenaChunk* next;
+    uint64_t capacity;
+    // [capacity] bytes follow
+};
+
+class BehaviourArena {
+private:
+    // Newest (and largest) chunk first. Only that one is kept across resets.
+    ArenaChunk* chunks = nullptr;
+    uint64_t used = 0;
+
+public:
+    BehaviourArena() = default;
+    BehaviourArena(const BehaviourArena&) = delete;
+    BehaviourArena& operator=(const BehaviourArena&) = delete;
+    ~BehaviourArena();
+    void* allocate(uint64_t size);
+    // Invalidates every block handed out so far
+    void reset();
+};
+
+// Header of the block holding the actor structs of a [handle_bulk_actor_creation]. The block is
+// freed once every instance in it has been reclaimed.
+struct ActorSlab {
+    RuntimeAtomic<uint64_t> live_instances;
+    // The actor structs follow
+};
+
+// Header of the block holding the per-receiver copies of a [handle_broadcast_behaviour_call]
+// message. The block is freed once every receiver has run the behaviour.
+struct BroadcastBlock {
+    RuntimeAtomic<uint64_t> pending_receivers;
+    // The message copies follow
+};
+
+/*
+Generated once per actor, as the constant <Actor>.descriptor, and passed to [handle_actor_creation].
+Messages name the behaviour they run by its index in [behaviour_fns], and [dispatch_fn] switches
+on it, so the runtime's indirect call only ever sees one target per actor.
+*/
+struct ActorDescriptor {
+    // Releases the references held by the members of an actor struct. May be null.
+    void (*drop_fn)(void*);
+    // Runs behaviour [behaviour_index] with the message and the actor struct
+    void (*dispatch_fn)(void* message, void* actor_struct, uint32_t behaviour_index);
+    uint64_t num_behaviours;
+    // The behaviours (<be>.<Actor>.be) by index, for senders that only know the function (see
+    // [coh_runtime_send])
+    void (* const* behaviour_fns)(void*, void*);
+};
+
+// Messages of at most this many bytes are carried in the [MailboxItem] itself (see
+// [reserve_inline_message])
+constexpr size_t INLINE_MESSAGE_SIZE = 32;
 
 struct MailboxItem {
     uint64_t actor_id;
+    // Null when the message is in [inline_message]
     void* message;
-    void (*behaviour_fn)(void*);
+    // Which behaviour of the receiver runs (see [ActorDescriptor])
+    uint32_t behaviour_index;
+    // The block [message] lives in when it was broadcast, else null
+    BroadcastBlock* broadcast = nullptr;
+    alignas(8) unsigned char inline_message[INLINE_MESSAGE_SIZE];
 };
 
 template <typename K, typename V>
 class ThreadSafeMap {
 private:
-    std::mutex map_lock;
+    RuntimeMutex map_lock;
     std::unordered_map<K, V> map;
 
 public:
     void insert(const K& key, const V& value) {
-        std::lock_guard<std::mutex> lock(map_lock);
+        std::lock_guard<RuntimeMutex> lock(map_lock);
         map.emplace(key, value);
     }
 
     std::optional<V> get_value(const K& key) {
-        std::lock_guard<std::mutex> lock(map_lock);
+        std::lock_guard<RuntimeMutex> lock(map_lock);
         auto it = map.find(key);
         if (it == map.end()) {
             return std::nullopt;
         }
         return it->second;
     }
+
+    // Looks up every key under a single acquisition of the lock. All of them must be present.
+    std::vector<V> get_values(const K* keys, size_t count) {
+        std::vector<V> values;
+        values.reserve(count);
+        std::lock_guard<RuntimeMutex> lock(map_lock);
+        for(size_t i = 0; i < count; i++) {
+            auto it = map.find(keys[i]);
+            assert(it != map.end());
+            values.push_back(it->second);
+        }
+        return values;
+    }
+
+    // Inserts every entry under a single acquisition of the lock
+    void insert_many(const std::vector<std::pair<K, V>>& entries) {
+        std::lock_guard<RuntimeMutex> lock(map_lock);
+        map.reserve(map.size() + entries.size());
+        for(const auto& [key, value]: entries) {
+            map.emplace(key, value);
+        }
+    }
+
+    void erase(const K& key) {
+        std::lock_guard<RuntimeMutex> lock(map_lock);
+        map.erase(key);
+    }
 };
 
 // User mutex is a reentrant lock at the source level
 class UserMutex {
 private:
     // A lock for exclusive access to [UserMutex] members
-    std::mutex coord_lock;
+    RuntimeMutex coord_lock;
     std::optional<uint64_t> holding_instance;
     // An actor instance can call [lock] multiple times. This simply increments
     // [num_lock_called], which is decremented when [unlock] is called. The lock
@@ -65,15 +225,43 @@ public:
 struct ActorInstanceState {
     enum class State {EMPTY, WAITING, RUNNABLE, RUNNING};
     State state;
-    std::mutex instance_lock;
+    RuntimeMutex instance_lock;
     void* llvm_actor_object;
     boost_ctx::fcontext_t next_continuation;
     void* running_be_sp;
     const uint64_t instance_id;
     std::deque<MailboxItem> mailbox;
-    ActorInstanceState(void* llvm_actor_object, const uint64_t instance_id)
+    // Number of [UserMutex]es this instance holds. Only changed by the instance itself while it
+    // runs, or by [UserMutex::unlock] handing a lock to it while it is waiting.
+    RuntimeAtomic<uint32_t> locks_held;
+    // Number of references to this instance held by actor members, locals, messages and pending
+    // timers, maintained by the generated code through [actor_retain] and [actor_release].
+    // Starts at 1 for the reference held by the creator until it has stored the new id.
+    RuntimeAtomic<uint64_t> ref_count;
+    // How the runtime drops [llvm_actor_object] and runs its behaviours
+    const ActorDescriptor* descriptor;
+    // Set, under [instance_lock], once the instance has been chosen to be freed
+    bool reclaimed;
+    // The block [llvm_actor_object] lives in when the instance was created in bulk, else null
+    ActorSlab* slab;
+    // The block the message of the running behaviour lives in when it was broadcast, else null
+    BroadcastBlock* running_broadcast;
+    // Where the running behaviour reads its message from when it was sent inline. The mailbox
+    // entry does not outlive the behaviour's first suspension, so the message is copied here.
+    alignas(8) unsigned char running_inline_message[INLINE_MESSAGE_SIZE];
+    // Serves the allocations of the generated code while this instance runs
+    ActorHeap heap;
+    // Serves the non-escaping allocations of the running behaviour, reset when it returns
+    BehaviourArena arena;
+    ActorInstanceState(void* llvm_actor_object, const uint64_t instance_id, const ActorDescriptor* descriptor)
         : instance_id(instance_id) {
         state = ActorInstanceState::State::EMPTY;
+        locks_held = 0;
+        ref_count = 1;
+        this->descriptor = descriptor;
+        reclaimed = false;
+        slab = nullptr;
+        running_broadcast = nullptr;
         this->llvm_actor_object = llvm_actor_object;
         next_continuation = nullptr;
         running_be_sp = nullptr;
@@ -83,21 +271,94 @@ struct ActorInstanceState {
 
 struct RuntimeDS {
     // When the schedule queue is empty, threads can sleep in [thread_bed]
-    std::condition_variable thread_bed;
-    std::mutex schedule_queue_lock;
-    std::atomic<uint8_t> threads_asleep;
-    std::atomic<uint64_t> instances_created;
+    RuntimeCondVar thread_bed;
+    // Whoever waits for quiescence sleeps here until the last worker goes idle
+    RuntimeCondVar quiescence_bed;
+    RuntimeMutex schedule_queue_lock;
+    // [threads_asleep], [num_workers] and [stopping] are protected by [schedule_queue_lock]
+    uint32_t threads_asleep;
+    uint32_t num_workers;
+    bool stopping = false;
+    RuntimeAtomic<uint64_t> instances_created;
+    uint64_t main_instance_id;
     std::deque<uint64_t> schedule_queue;
-    ThreadSafeMap<uint64_t, std::shared_ptr<ActorInstanceState>> id_actor_instance_map;
+    // Runnable instances that hold locks. They run before everything in [schedule_queue], so
+    // that critical sections others are waiting on finish quickly.
+    std::deque<uint64_t> priority_schedule_queue;
+    ThreadSafeMap<uint64_t, ActorInstanceRef> id_actor_instance_map;
     std::unordered_map<uint64_t, UserMutex> mutex_map;
+    // Messages sent with [after N ms]. The wheel ticks in milliseconds since [start_time].
+    // [timer_lock] protects [timer_wheel] and is never held while taking another lock.
+    RuntimeMutex timer_lock;
+    TimerWheel<MailboxItem> timer_wheel;
+    std::chrono::steady_clock::time_point start_time;
+    // Mirrors of the wheel's state, so the scheduler can check for due timers without locking
+    RuntimeAtomic<uint64_t> pending_timers;
+    RuntimeAtomic<uint64_t> next_timer_wakeup_ms;
     RuntimeDS() {}
+
+    // The following must be called with [schedule_queue_lock] held
+    bool has_runnable() const {
+        return !schedule_queue.empty() || !priority_schedule_queue.empty();
+    }
+    void push_runnable(uint64_t instance_id, bool holds_locks) {
+        if(holds_locks) {
+            priority_schedule_queue.emplace_back(instance_id);
+        }
+        else {
+            schedule_queue.emplace_back(instance_id);
+        }
+    }
+    uint64_t pop_runnable() {
+        std::deque<uint64_t>& queue = 
+            priority_schedule_queue.empty() ? schedule_queue : priority_schedule_queue;
+        uint64_t instance_id = queue.front();
+        queue.pop_front();
+        return instance_id;
+    }
 };
 
+// The instance being run by the current worker thread
+extern thread_local ActorInstanceState* running_instance;
+
+inline ActorInstanceRef make_actor_instance(
+    void* llvm_actor_object, 
+    uint64_t instance_id,
+    const ActorDescriptor* descriptor) {
+#ifdef COH_SINGLE_THREADED
+    return new ActorInstanceState(llvm_actor_object, instance_id, descriptor);
+#else
+    return std::make_shared<ActorInstanceState>(llvm_actor_object, instance_id, descriptor);
+#endif
+}
+
+#ifdef COH_SINGLE_THREADED
+// Only one actor runs at a time, and an atomic section acquires all of its locks before it
+// can yield, so a lock is never held by a suspended actor. Acquiring reduces to an owner check.
+inline bool UserMutex::lock(RuntimeDS*, uint64_t instance_id) {
+    assert(holding_instance == std::nullopt || holding_instance == instance_id);
+    if(holding_instance == std::nullopt) {
+        running_instance->locks_held++;
+    }
+    holding_instance = instance_id;
+    num_lock_called++;
+    return true;
+}
+
+inline void UserMutex::unlock(RuntimeDS*) {
+    num_lock_called--;
+    if(num_lock_called == 0) {
+        holding_instance = std::nullopt;
+        running_instance->locks_held--;
+    }
+}
+#else
 inline bool UserMutex::lock(RuntimeDS* runtime_ds, uint64_t instance_id) {
     // Atomic section for mutual exclusion
     std::lock_guard<std::mutex> lock_guard(coord_lock);
     if(holding_instance == std::nullopt) {
         holding_instance = instance_id;
+        running_instance->locks_held++;
     }
     if(holding_instance == instance_id) {
         num_lock_called++;
@@ -105,10 +366,10 @@ inline bool UserMutex::lock(RuntimeDS* runtime_ds, uint64_t instance_id) {
     }
     auto actor_instance_state_opt = runtime_ds->id_actor_instance_map.get_value(instance_id);
     assert(actor_instance_state_opt != std::nullopt);
-    std::shared_ptr<ActorInstanceState> actor_instance_state = actor_instance_state_opt.value();
+    ActorInstanceRef actor_instance_state = actor_instance_state_opt.value();
     std::lock_guard<std::mutex> instance_guard(actor_instance_state->instance_lock);
     actor_instance_state->state = ActorInstanceState::State::WAITING;
-    MailboxItem dummy_msg{instance_id, nullptr, nullptr};
+    MailboxItem dummy_msg{instance_id, nullptr, 0};
     actor_instance_state->mailbox.emplace_front(dummy_msg);
     wait_queue.emplace_back(instance_id);
     return false;
@@ -122,6 +383,7 @@ inline void UserMutex::unlock(RuntimeDS* runtime) {
     if(num_lock_called > 0) {
         return;
     }
+    running_instance->locks_held--;
 
     // Try to wake the next waiting actor
     if(wait_queue.size() == 0) {
@@ -136,7 +398,7 @@ inline void UserMutex::unlock(RuntimeDS* runtime) {
     auto actor_instance_state_opt = 
         runtime->id_actor_instance_map.get_value(actor_instance_id);
     assert(actor_instance_state_opt != std::nullopt);
-    std::shared_ptr<ActorInstanceState> actor_instance_state = *actor_instance_state_opt;
+    ActorInstanceRef actor_instance_state = *actor_instance_state_opt;
     // Now acquire the instance lock
     std::lock_guard<std::mutex> instance_guard(actor_instance_state->instance_lock);
     assert(!actor_instance_state->mailbox.empty());
@@ -145,8 +407,10 @@ inline void UserMutex::unlock(RuntimeDS* runtime) {
     // Giving the lock to [actor_instance_id]
     holding_instance = actor_instance_id;
     num_lock_called = 1;
+    actor_instance_state->locks_held++;
     std::lock_guard<std::mutex> schedule_queue_guard(runtime->schedule_queue_lock);
-    runtime->schedule_queue.emplace_back(actor_instance_id);
+    runtime->push_runnable(actor_instance_id, true);
     runtime->thread_bed.notify_one();
     return;
 }
+#endif
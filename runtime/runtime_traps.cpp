@@ -1,41 +1,245 @@
 #include "runtime_traps.hpp"
+#include "output_buffer.hpp"
+#include <algorithm>
 #include <cassert>
 #include <atomic>
-#include <iostream>
-#include <syncstream>
+#include <cstring>
+#include <new>
+#include <vector>
 
 void print_int(int i) {
-    std::osyncstream(std::cout) << i << "\n";
+    buffer_int_output(i);
+}
+
+void coh_fill_array(void* base, uint64_t elem_size, uint64_t count) {
+    char* bytes = static_cast<char*>(base);
+    uint64_t total = elem_size * count;
+    // [filled] doubles every copy, so an array takes O(log count) memcpys
+    uint64_t filled = elem_size;
+    while(filled < total) {
+        uint64_t chunk = std::min(filled, total - filled);
+        std::memcpy(bytes + filled, bytes, chunk);
+        filled += chunk;
+    }
 }
 
 void handle_unlock(std::uint64_t lock_id) {
+    // The next holder of the lock may observe what was sent and printed in the atomic section
+    flush_send_buffer();
+    publish_output();
     assert(runtime_ds->mutex_map.find(lock_id) != runtime_ds->mutex_map.end());
     UserMutex& mutex = (runtime_ds->mutex_map)[lock_id];
     mutex.unlock(runtime_ds);
 }
 
-void handle_behaviour_call(
-    uint64_t instance_id,
-    void* message,
-    void (*behaviour_fn)(void*)
-) {
+// Appends [items] to the mailbox of [actor_instance] under one acquisition of its lock, and
+// schedules it if it was idle
+static void deliver_messages(
+    ActorInstanceRef& actor_instance, 
+    uint64_t instance_id, 
+    const MailboxItem* items, 
+    size_t count) {
     using State = ActorInstanceState::State;
-    auto actor_instance_opt = runtime_ds->id_actor_instance_map.get_value(instance_id);
-    assert(actor_instance_opt != std::nullopt);
-    std::shared_ptr<ActorInstanceState> actor_instance = *actor_instance_opt;
-    std::lock_guard<std::mutex> instance_guard(actor_instance->instance_lock);
-    actor_instance->mailbox.emplace_back(MailboxItem { instance_id, message, behaviour_fn });
+    // The receiver may print in response to these messages
+    publish_output();
+    std::lock_guard<RuntimeMutex> instance_guard(actor_instance->instance_lock);
+    actor_instance->mailbox.insert(actor_instance->mailbox.end(), items, items + count);
     if(actor_instance->state == State::EMPTY) {
         actor_instance->state = State::RUNNABLE;
         {
-            std::lock_guard<std::mutex> schedule_guard(runtime_ds->schedule_queue_lock);
-            runtime_ds->schedule_queue.emplace_back(instance_id);
+            std::lock_guard<RuntimeMutex> schedule_guard(runtime_ds->schedule_queue_lock);
+            runtime_ds->push_runnable(instance_id, actor_instance->locks_held > 0);
             runtime_ds->thread_bed.notify_one();
         }
     }
 }
 
+void deliver_external_message(
+    ActorInstanceRef& actor_instance, 
+    uint64_t instance_id, 
+    void* message, 
+    uint32_t behaviour_index) {
+    MailboxItem item { instance_id, message, behaviour_index };
+    deliver_messages(actor_instance, instance_id, &item, 1);
+}
+
+// Messages sent by the running behaviour to [receiver] that are not in its mailbox yet.
+// Consecutive sends to the same receiver collect here and are delivered together when the
+// behaviour sends to someone else, returns, suspends or releases a lock, so the order in which the
+// messages of a behaviour become visible is the order they were sent in.
+struct SendBuffer {
+    uint64_t receiver_id = 0;
+    // Holds a reference, so the receiver is not reclaimed while messages to it are buffered
+    ActorInstanceRef receiver{};
+    std::vector<MailboxItem> items;
+};
+static thread_local SendBuffer send_buffer;
+// Bounds how long a receiver waits for the messages of a long running sender
+static constexpr size_t SEND_BUFFER_LIMIT = 256;
+
+void flush_send_buffer() {
+    if(send_buffer.receiver_id == 0) {
+        return;
+    }
+    deliver_messages(
+        send_buffer.receiver, send_buffer.receiver_id, send_buffer.items.data(), send_buffer.items.size());
+    send_buffer.items.clear();
+    send_buffer.receiver_id = 0;
+    ActorInstanceRef receiver = std::move(send_buffer.receiver);
+    send_buffer.receiver = ActorInstanceRef{};
+    if(--(receiver->ref_count) == 0) {
+        try_reclaim_instance(receiver);
+    }
+}
+
+// Appends a message to [send_buffer], flushing it first if it holds messages to another receiver
+// (or too many messages)
+static MailboxItem& buffer_send(uint64_t instance_id, void* message, uint32_t behaviour_index) {
+    if(send_buffer.receiver_id != instance_id || send_buffer.items.size() >= SEND_BUFFER_LIMIT) {
+        flush_send_buffer();
+        auto actor_instance_opt = runtime_ds->id_actor_instance_map.get_value(instance_id);
+        assert(actor_instance_opt != std::nullopt);
+        send_buffer.receiver = *actor_instance_opt;
+        send_buffer.receiver->ref_count++;
+        send_buffer.receiver_id = instance_id;
+    }
+    return send_buffer.items.emplace_back(MailboxItem { instance_id, message, behaviour_index });
+}
+
+void handle_behaviour_call(
+    uint64_t instance_id,
+    void* message,
+    uint32_t behaviour_index
+) {
+    if(running_instance == nullptr) {
+        // Not sent by a behaviour (e.g. the initial message), so nothing flushes a buffer
+        auto actor_instance_opt = runtime_ds->id_actor_instance_map.get_value(instance_id);
+        assert(actor_instance_opt != std::nullopt);
+        deliver_external_message(*actor_instance_opt, instance_id, message, behaviour_index);
+        return;
+    }
+    buffer_send(instance_id, message, behaviour_index);
+}
+
+void* reserve_inline_message(uint64_t instance_id, uint32_t behaviour_index) {
+    // Only behaviours send inline messages, and the message is filled in before they next call
+    // into the runtime, which is the earliest the buffer can be flushed
+    assert(running_instance != nullptr);
+    return buffer_send(instance_id, nullptr, behaviour_index).inline_message;
+}
+
+void handle_broadcast_behaviour_call(
+    const uint64_t* instance_ids,
+    uint64_t count,
+    void* message,
+    uint64_t message_size,
+    uint32_t behaviour_index
+) {
+    using State = ActorInstanceState::State;
+    if(count == 0) {
+        coh_free(message);
+        return;
+    }
+    // Earlier sends of the running behaviour arrive first
+    flush_send_buffer();
+    publish_output();
+    void* block = coh_alloc(sizeof(BroadcastBlock) + count * message_size);
+    BroadcastBlock* broadcast = new (block) BroadcastBlock;
+    broadcast->pending_receivers = count;
+    char* copies = reinterpret_cast<char*>(broadcast + 1);
+    for(uint64_t i = 0; i < count; i++) {
+        char* copy = copies + i * message_size;
+        std::memcpy(copy, message, message_size - sizeof(uint64_t));
+        std::memcpy(copy + message_size - sizeof(uint64_t), &instance_ids[i], sizeof(uint64_t));
+    }
+    coh_free(message);
+
+    std::vector<ActorInstanceRef> receivers = 
+        runtime_ds->id_actor_instance_map.get_values(instance_ids, count);
+    // (id, holds locks) of the receivers this message made runnable
+    std::vector<std::pair<uint64_t, bool>> woken;
+    for(uint64_t i = 0; i < count; i++) {
+        ActorInstanceRef& receiver = receivers[i];
+        std::lock_guard<RuntimeMutex> instance_guard(receiver->instance_lock);
+        receiver->mailbox.emplace_back(
+            MailboxItem { instance_ids[i], copies + i * message_size, behaviour_index, broadcast });
+        if(receiver->state == State::EMPTY) {
+            receiver->state = State::RUNNABLE;
+            woken.emplace_back(instance_ids[i], receiver->locks_held > 0);
+        }
+    }
+    if(woken.empty()) {
+        return;
+    }
+    std::lock_guard<RuntimeMutex> schedule_guard(runtime_ds->schedule_queue_lock);
+    for(auto& [instance_id, holds_locks]: woken) {
+        runtime_ds->push_runnable(instance_id, holds_locks);
+    }
+    if(woken.size() == 1) {
+        runtime_ds->thread_bed.notify_one();
+    }
+    else {
+        runtime_ds->thread_bed.notify_all();
+    }
+}
+
+void release_message(void* message) {
+    if(message == running_instance->running_inline_message) {
+        return;
+    }
+    BroadcastBlock* broadcast = running_instance->running_broadcast;
+    if(broadcast == nullptr) {
+        coh_free(message);
+        return;
+    }
+    running_instance->running_broadcast = nullptr;
+    if(--(broadcast->pending_receivers) == 0) {
+        coh_free(broadcast);
+    }
+}
+
+void handle_delayed_behaviour_call(
+    uint64_t instance_id,
+    void* message,
+    uint32_t behaviour_index,
+    int32_t delay_ms
+) {
+    if(delay_ms <= 0) {
+        handle_behaviour_call(instance_id, message, behaviour_index);
+        return;
+    }
+    // The timer may expire before the running behaviour returns, and its message must not overtake
+    // earlier sends
+    flush_send_buffer();
+    publish_output();
+    // The pending timer holds a reference to the receiver until the message is delivered
+    actor_retain(instance_id);
+    // The current millisecond has partially elapsed, so round the deadline up
+    uint64_t now = runtime_now_ms();
+    uint64_t deadline = now + static_cast<uint64_t>(delay_ms) + 1;
+    bool earliest_timer;
+    {
+        std::lock_guard<RuntimeMutex> timer_guard(runtime_ds->timer_lock);
+        runtime_ds->timer_wheel.insert(
+            now, deadline, MailboxItem { instance_id, message, behaviour_index });
+        uint64_t wakeup = *runtime_ds->timer_wheel.next_wakeup();
+        earliest_timer = wakeup < runtime_ds->next_timer_wakeup_ms;
+        if(earliest_timer) {
+            runtime_ds->next_timer_wakeup_ms = wakeup;
+        }
+        runtime_ds->pending_timers = runtime_ds->timer_wheel.size();
+    }
+    if(earliest_timer) {
+        // Sleeping workers have to shorten their sleep
+        std::lock_guard<RuntimeMutex> schedule_guard(runtime_ds->schedule_queue_lock);
+        runtime_ds->thread_bed.notify_one();
+    }
+}
+
 void* get_instance_struct(uint64_t instance_id) {
+    if(instance_id == 0) {
+        return nullptr;
+    }
     auto actor_instance_opt = runtime_ds->id_actor_instance_map.get_value(instance_id);
     assert(actor_instance_opt != std::nullopt);
     auto actor_instance = *actor_instance_opt;
@@ -46,24 +250,128 @@ void* get_instance_struct(uint64_t instance_id) {
 // Called by LLVM right after allocating actor memory.
 // Only registers the actor and returns its unique instance_id.
 // Constructor runs synchronously in the caller, not the actor.
-uint64_t handle_actor_creation(void* llvm_actor_object)
+uint64_t handle_actor_creation(void* llvm_actor_object, const ActorDescriptor* descriptor)
 {
     uint64_t instance_id = ++(runtime_ds->instances_created);
 
-    auto state = std::make_shared<ActorInstanceState>(llvm_actor_object, instance_id);
+    ActorInstanceRef state = make_actor_instance(llvm_actor_object, instance_id, descriptor);
 
     runtime_ds->id_actor_instance_map.insert(instance_id, state);
     return instance_id;
 }
 
-void suspend_instance(uint64_t actor_instance_id, void* suspend_tag) {
-    auto actor_instance_opt = runtime_ds->id_actor_instance_map.get_value(actor_instance_id);
+uint64_t handle_bulk_actor_creation(uint64_t count, uint64_t struct_size, const ActorDescriptor* descriptor) {
+    if(count == 0) {
+        return 0;
+    }
+    // One range of ids and one (zeroed) block for all the actor structs
+    uint64_t first_id = (runtime_ds->instances_created += count) - count + 1;
+    uint64_t stride = (struct_size + 7) & ~uint64_t(7);
+    void* block = coh_alloc_zeroed(sizeof(ActorSlab) + count * stride);
+    ActorSlab* slab = new (block) ActorSlab;
+    slab->live_instances = count;
+    char* structs = reinterpret_cast<char*>(slab + 1);
+
+    std::vector<std::pair<uint64_t, ActorInstanceRef>> instances;
+    instances.reserve(count);
+    for(uint64_t i = 0; i < count; i++) {
+        ActorInstanceRef state = make_actor_instance(structs + i * stride, first_id + i, descriptor);
+        state->slab = slab;
+        instances.emplace_back(first_id + i, std::move(state));
+    }
+    runtime_ds->id_actor_instance_map.insert_many(instances);
+    return first_id;
+}
+
+void actor_retain(uint64_t instance_id) {
+    if(instance_id == 0) {
+        return;
+    }
+    auto actor_instance_opt = runtime_ds->id_actor_instance_map.get_value(instance_id);
+    assert(actor_instance_opt != std::nullopt);
+    (*actor_instance_opt)->ref_count++;
+}
+
+void actor_retain_many(uint64_t instance_id, uint64_t count) {
+    if(instance_id == 0 || count == 0) {
+        return;
+    }
+    auto actor_instance_opt = runtime_ds->id_actor_instance_map.get_value(instance_id);
     assert(actor_instance_opt != std::nullopt);
-    std::shared_ptr<ActorInstanceState> actor_instance = *actor_instance_opt;
+    (*actor_instance_opt)->ref_count += count;
+}
+
+void actor_release(uint64_t instance_id) {
+    if(instance_id == 0) {
+        return;
+    }
+    auto actor_instance_opt = runtime_ds->id_actor_instance_map.get_value(instance_id);
+    assert(actor_instance_opt != std::nullopt);
+    ActorInstanceRef actor_instance = *actor_instance_opt;
+    assert(actor_instance->ref_count > 0);
+    if(--(actor_instance->ref_count) == 0) {
+        try_reclaim_instance(actor_instance);
+    }
+}
+
+// Dropping an instance releases its members, which can reclaim further instances. They are
+// queued here instead of being dropped recursively, so long chains of actors can not overflow
+// the (small) behaviour stacks.
+static thread_local std::vector<ActorInstanceRef> instances_to_drop;
+static thread_local bool dropping_instances = false;
+
+void try_reclaim_instance(ActorInstanceRef actor_instance) {
+    using State = ActorInstanceState::State;
+    {
+        std::lock_guard<RuntimeMutex> instance_guard(actor_instance->instance_lock);
+        // Only referenced ids can be sent to, so a count of 0 can not grow again
+        if(actor_instance->reclaimed || 
+            actor_instance->ref_count != 0 || 
+            actor_instance->state != State::EMPTY ||
+            !actor_instance->mailbox.empty()) {
+            return;
+        }
+        actor_instance->reclaimed = true;
+    }
+    runtime_ds->id_actor_instance_map.erase(actor_instance->instance_id);
+    instances_to_drop.push_back(actor_instance);
+    if(dropping_instances) {
+        return;
+    }
+    dropping_instances = true;
+    while(!instances_to_drop.empty()) {
+        ActorInstanceRef instance = instances_to_drop.back();
+        instances_to_drop.pop_back();
+        if(instance->descriptor->drop_fn != nullptr) {
+            instance->descriptor->drop_fn(instance->llvm_actor_object);
+        }
+        if(instance->slab == nullptr) {
+            coh_free(instance->llvm_actor_object);
+        }
+        else if(--(instance->slab->live_instances) == 0) {
+            instance->slab->~ActorSlab();
+            coh_free(instance->slab);
+        }
+#ifdef COH_SINGLE_THREADED
+        delete instance;
+#endif
+    }
+    dropping_instances = false;
+}
+
+void suspend_instance(uint64_t actor_instance_id, void* suspend_tag) {
+    // A suspended (or running) instance is never reclaimed, so a plain pointer is enough. Holding
+    // an [ActorInstanceRef] here would leak it: a RETURN never jumps back into this frame.
+    ActorInstanceState* actor_instance;
+    {
+        auto actor_instance_opt = runtime_ds->id_actor_instance_map.get_value(actor_instance_id);
+        assert(actor_instance_opt != std::nullopt);
+        actor_instance = &**actor_instance_opt;
+    }
     // As there is nothing else that has access to the state
     boost_ctx::fcontext_t main_ctx;
     {
-        std::lock_guard<std::mutex> instance_guard(actor_instance->instance_lock);
+        std::lock_guard<RuntimeMutex> instance_guard(actor_instance->instance_lock);
         assert(actor_instance->state == ActorInstanceState::State::RUNNING);
         // As it is running, nothing else should be accessing the continuation.
         main_ctx = actor_instance->next_continuation;
@@ -3,6 +3,27 @@
 
 extern RuntimeDS* runtime_ds;
 
+// Timer helpers (implemented in scheduler.cpp)
+uint64_t runtime_now_ms();
+// Advances the timer wheel and delivers every message whose delay has elapsed
+void deliver_expired_timers();
+
+// Delivers the messages the running behaviour has buffered (see [handle_behaviour_call]). Called
+// whenever the behaviour returns, suspends or releases a lock.
+void flush_send_buffer();
+
+// Delivers a message sent from outside any behaviour (e.g. by a host thread), which nothing
+// buffers, to [actor_instance]
+void deliver_external_message(
+    ActorInstanceRef& actor_instance, 
+    uint64_t instance_id, 
+    void* message, 
+    uint32_t behaviour_index);
+
+// Frees [actor_instance] if nothing references it and it has nothing left to run. Safe to call
+// at any time; the conditions are checked under the instance lock.
+void try_reclaim_instance(ActorInstanceRef actor_instance);
+
 #pragma pack(push, 1)
 enum SuspendTagKind: uint32_t {
     RETURN = 0,
@@ -14,17 +35,71 @@ struct SuspendTag {
 };
 #pragma pack(pop)
 
+// Implementations of [coh_alloc], [coh_alloc_zeroed] and [coh_free], chosen when the program is
+// compiled (--allocator) and stored in [coh_allocator_backend] by the generated code
+enum class AllocatorBackend: uint8_t {
+    // Per-actor heaps (see [ActorHeap])
+    ACTOR_HEAP = 0,
+    // malloc and free
+    LIBC = 1,
+    // Thread-local free lists per size class, refilled from shared ones (see allocators.cpp)
+    SIZE_CLASS = 2,
+    // Thread-local bump allocation that never frees. Only meant for benchmarking.
+    BUMP = 3
+};
+
 extern "C" {  
     // Utilities
     void print_int(int);
+    // Allocation for generated code (see [AllocatorBackend]). [coh_free] may be called from any
+    // thread.
+    void* coh_alloc(uint64_t size);
+    void coh_free(void* block);
+    // Allocation for memory that does not outlive the running behaviour (see [BehaviourArena])
+    void* coh_arena_alloc(uint64_t size);
+    // Same as [coh_alloc], but the block is zeroed
+    void* coh_alloc_zeroed(uint64_t size);
+    // Copies the first [elem_size] bytes at [base] into the following [count - 1] elements
+    void coh_fill_array(void* base, uint64_t elem_size, uint64_t count);
     
     // Non interrupting traps (called directly from LLVM)
     void handle_unlock(uint64_t lock_id);
+    // Messages sent while a behaviour runs are buffered, and consecutive ones to the same receiver
+    // enter its mailbox together (see [flush_send_buffer])
     void handle_behaviour_call(
         uint64_t instance_id,
         void* message,
-        void (*behaviour_fn)(void*)
+        uint32_t behaviour_index
+    );
+    // Like [handle_behaviour_call], but the message is only delivered after [delay_ms]
+    void handle_delayed_behaviour_call(
+        uint64_t instance_id,
+        void* message,
+        uint32_t behaviour_index,
+        int32_t delay_ms
     );
+    /*
+    Sends the message to the first [count] instances in [instance_ids] at once. [message] is
+    [message_size] bytes, ending with the receiver id, and is freed by the runtime. Every receiver
+    gets its own copy (with its id filled in) inside a single block, and the mailboxes are filled
+    before the instances that became runnable are scheduled in one go.
+    */
+    void handle_broadcast_behaviour_call(
+        const uint64_t* instance_ids,
+        uint64_t count,
+        void* message,
+        uint64_t message_size,
+        uint32_t behaviour_index
+    );
+    /*
+    Sends a message of at most [INLINE_MESSAGE_SIZE] bytes without allocating it: returns where
+    the caller writes the message, inside the mailbox entry. Only for sends from a behaviour,
+    which must fill in the message before calling into the runtime again.
+    */
+    void* reserve_inline_message(uint64_t instance_id, uint32_t behaviour_index);
+    // Called by a behaviour once it no longer reads its message
+    void release_message(void* message);
+    // The actor struct of [instance_id], or null for id 0
     void* get_instance_struct(uint64_t instance_id);
     /* 
     It is llvm's responsibility to allocate space for the actor instance. It passes it
@@ -35,8 +110,28 @@ extern "C" {
     2. Register the actor using [handle_actor_creation] to get an instance_id
     3. LLVM calls the constructor
     4. LLVM forgets the pointer to the llvm_actor_object 
+    The instance starts with a reference count of 1, which LLVM releases once the new id has
+    been stored (or immediately, if it never is). When the count drops to 0 and the mailbox is
+    empty, the drop function of [descriptor] releases the references held by the members and the
+    object is freed.
+    */
+    std::uint64_t handle_actor_creation(void* llvm_actor_object, const ActorDescriptor* descriptor);
+    /*
+    Registers [count] zeroed instances of an actor whose struct is [struct_size] bytes, with one
+    allocation for all the structs and one registry update, and returns the first of their
+    consecutive ids (0 if [count] is 0). Each instance starts with a reference count of 1, held by
+    the array LLVM stores the ids in. LLVM then runs the constructors with the ids. The structs
+    follow each other in id order, [struct_size] rounded up to a multiple of 8 apart.
     */
-    std::uint64_t handle_actor_creation(void* llvm_actor_object);
+    std::uint64_t handle_bulk_actor_creation(
+        uint64_t count, 
+        uint64_t struct_size, 
+        const ActorDescriptor* descriptor);
+    // Reference counting of actor ids. Id 0 (a zero-initialised slot) is ignored.
+    void actor_retain(uint64_t instance_id);
+    void actor_release(uint64_t instance_id);
+    // Takes [count] references at once (e.g. one per element of a new array)
+    void actor_retain_many(uint64_t instance_id, uint64_t count);
 
     void suspend_instance(uint64_t actor_instance_id, void* suspend_tag);
 }
\ No newline at end of file
@@ -0,0 +1,321 @@
+#include "runtime_traps.hpp"
+#include "coherence_runtime.h"
+#include "output_buffer.hpp"
+#include <iostream>
+#include <assert.h>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <condition_variable>
+
+/*
+Lock order:
+(lock mutex) ---> (Actor-instance lock) --> (schedule queue lock)
+The timer lock is a leaf: expired messages are delivered after it is released.
+*/
+
+extern "C" void coherence_initialize();
+extern "C" uint64_t num_locks;
+
+// 256KB stacks
+static std::size_t stack_size = 256 * 1024;
+#ifdef COH_SINGLE_THREADED
+static constexpr uint32_t DEFAULT_NUM_WORKERS = 1;
+#else
+static constexpr uint32_t DEFAULT_NUM_WORKERS = 16;
+#endif
+RuntimeDS* runtime_ds;
+thread_local ActorInstanceState* running_instance = nullptr;
+static std::vector<std::thread> workers;
+
+void call_behaviour_context(boost_ctx::transfer_t t) {
+    boost_ctx::fcontext_t main_ctx = t.fctx;
+    MailboxItem* mailbox_item = reinterpret_cast<MailboxItem*>(t.data);
+    // Passed to the behaviour, which addresses the members of the receiver through it
+    void* actor_struct;
+    const ActorDescriptor* descriptor;
+    {
+        // This frame is never unwound (the stack is freed once the behaviour returns), so the
+        // reference to the instance must not outlive this scope
+        auto actor_instance_opt = runtime_ds->id_actor_instance_map.get_value(mailbox_item->actor_id); 
+        assert(actor_instance_opt != std::nullopt);
+        auto actor_instance = *actor_instance_opt;
+        actor_instance->next_continuation = main_ctx;
+        actor_struct = actor_instance->llvm_actor_object;
+        descriptor = actor_instance->descriptor;
+    }
+    descriptor->dispatch_fn(mailbox_item->message, actor_struct, mailbox_item->behaviour_index);
+    // Should never reach here
+    assert(false);
+}
+
+void run_instance(uint64_t actor_instance_id) {
+    using State = ActorInstanceState::State;
+
+    auto actor_instance_state_opt = 
+        runtime_ds->id_actor_instance_map.get_value(actor_instance_id);
+    assert(actor_instance_state_opt != std::nullopt);
+    ActorInstanceRef actor_instance_state = *actor_instance_state_opt;
+    running_instance = &*actor_instance_state;
+
+    MailboxItem msg;
+    {
+        std::lock_guard<RuntimeMutex> instance_guard(actor_instance_state->instance_lock);
+        assert(actor_instance_state->state == State::RUNNABLE);
+        actor_instance_state->state = State::RUNNING;
+        assert(!actor_instance_state->mailbox.empty());
+        msg = actor_instance_state->mailbox.front();
+        actor_instance_state->mailbox.pop_front();
+    }
+    // If the actor_instace_state->next_continuation != std::nullptr, this means that we need to
+    // call that continuation
+    if(actor_instance_state->next_continuation == nullptr) {
+        // Need to pop message from the stack and fill out the continuation
+        assert(actor_instance_state->running_be_sp == nullptr);
+        void *sp = std::malloc(stack_size);
+        actor_instance_state->next_continuation = boost_ctx::make_fcontext(
+            static_cast<char*>(sp) + stack_size, stack_size, call_behaviour_context);
+        actor_instance_state->running_be_sp = sp;
+        actor_instance_state->running_broadcast = msg.broadcast;
+        if(msg.message == nullptr) {
+            std::memcpy(actor_instance_state->running_inline_message, msg.inline_message, INLINE_MESSAGE_SIZE);
+            msg.message = actor_instance_state->running_inline_message;
+        }
+    }
+    
+    bool loop_done = false;
+    bool returned = false;
+    while (!loop_done) {
+        boost_ctx::transfer_t t = boost_ctx::jump_fcontext(
+            actor_instance_state->next_continuation, &msg);
+        SuspendTag* tag = reinterpret_cast<SuspendTag*>(t.data); 
+        // The actor may be resumed on another worker
+        flush_send_buffer();
+        publish_output();
+        switch(tag->kind) {
+            case SuspendTagKind::RETURN:
+                actor_instance_state->next_continuation = nullptr;
+                std::free(actor_instance_state->running_be_sp);
+                actor_instance_state->running_be_sp = nullptr;
+                actor_instance_state->arena.reset();
+                loop_done = true;
+                returned = true;
+                {
+                    std::lock_guard<RuntimeMutex> instance_guard(actor_instance_state->instance_lock);
+                    if(actor_instance_state->mailbox.empty()) {
+                        actor_instance_state->state = State::EMPTY;
+                    }
+                    else {
+                        actor_instance_state->state = State::RUNNABLE;
+                        {
+                            std::lock_guard<RuntimeMutex> thread_guard(runtime_ds->schedule_queue_lock);
+                            runtime_ds->push_runnable(actor_instance_id, actor_instance_state->locks_held > 0);
+                            runtime_ds->thread_bed.notify_one();
+                        }
+                        
+                    }
+                }
+                break;
+            case SuspendTagKind::LOCK: {
+                // Need to make sure that when [actor_instance_state] is added, it has the
+                // correct continuation
+                actor_instance_state->next_continuation = t.fctx;
+                assert(runtime_ds->mutex_map.find(tag->lock_id) != runtime_ds->mutex_map.end());
+                UserMutex& mtx = runtime_ds->mutex_map[tag->lock_id];
+                bool acquired_lock = mtx.lock(runtime_ds, actor_instance_id);
+                if(acquired_lock) {
+                    continue;
+                }
+                loop_done = true;
+                break;
+            }
+            default:
+                assert(false);
+        }
+    }
+    running_instance = nullptr;
+    if(returned) {
+        // The instance may have become unreferenced while it was running
+        try_reclaim_instance(actor_instance_state);
+    }
+}
+
+uint64_t runtime_now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - runtime_ds->start_time).count();
+}
+
+void deliver_expired_timers() {
+    if(runtime_ds->pending_timers == 0 || runtime_now_ms() < runtime_ds->next_timer_wakeup_ms) {
+        return;
+    }
+    std::vector<MailboxItem> expired;
+    {
+        std::lock_guard<RuntimeMutex> timer_guard(runtime_ds->timer_lock);
+        runtime_ds->timer_wheel.advance(runtime_now_ms(), expired);
+        runtime_ds->next_timer_wakeup_ms = 
+            runtime_ds->timer_wheel.next_wakeup().value_or(UINT64_MAX);
+        runtime_ds->pending_timers = runtime_ds->timer_wheel.size();
+    }
+    for(MailboxItem& item: expired) {
+        handle_behaviour_call(item.actor_id, item.message, item.behaviour_index);
+        // Taken by [handle_delayed_behaviour_call]. The message now keeps the receiver alive.
+        actor_release(item.actor_id);
+    }
+}
+
+static std::chrono::steady_clock::time_point next_timer_wakeup() {
+    return runtime_ds->start_time + std::chrono::milliseconds(runtime_ds->next_timer_wakeup_ms);
+}
+
+void thread_loop() {
+    while (true) {
+        deliver_expired_timers();
+        uint64_t actor_instance_id;
+        {
+            std::unique_lock<RuntimeMutex> lock_guard(runtime_ds->schedule_queue_lock);
+            // Set when a sleeping worker wakes up because a timer is due
+            bool timer_due = false;
+            while(!runtime_ds->has_runnable() && !timer_due) {
+#ifdef COH_SINGLE_THREADED
+                // Nothing left to run: hand control back to whoever is driving the runtime
+                if(runtime_ds->pending_timers == 0) {
+                    return;
+                }
+                std::this_thread::sleep_until(next_timer_wakeup());
+                timer_due = true;
+#else
+                if(runtime_ds->stopping) {
+                    return;
+                }
+                bool timers_pending = runtime_ds->pending_timers != 0;
+                runtime_ds->threads_asleep++;
+                if(runtime_ds->threads_asleep == runtime_ds->num_workers && !timers_pending) {
+                    runtime_ds->quiescence_bed.notify_all();
+                }
+                if(timers_pending) {
+                    timer_due = runtime_ds->thread_bed.wait_until(lock_guard, next_timer_wakeup()) 
+                        == std::cv_status::timeout;
+                }
+                else {
+                    runtime_ds->thread_bed.wait(lock_guard);
+                }
+                runtime_ds->threads_asleep--;
+#endif
+            }
+            if(!runtime_ds->has_runnable()) {
+                continue;
+            }
+            actor_instance_id = runtime_ds->pop_runnable();
+        }
+        run_instance(actor_instance_id);
+    }
+}
+
+void coh_runtime_init(const CohRuntimeConfig* config) {
+    runtime_ds = new RuntimeDS();
+    runtime_ds->instances_created = 0;
+    runtime_ds->threads_asleep = 0;
+    runtime_ds->num_workers = DEFAULT_NUM_WORKERS;
+    runtime_ds->start_time = std::chrono::steady_clock::now();
+    runtime_ds->pending_timers = 0;
+    runtime_ds->next_timer_wakeup_ms = UINT64_MAX;
+#ifndef COH_SINGLE_THREADED
+    if(config != nullptr && config->num_workers != 0) {
+        runtime_ds->num_workers = config->num_workers;
+    }
+#endif
+    for(uint64_t lock_id = 0; lock_id < num_locks; lock_id++) {
+        runtime_ds->mutex_map.try_emplace(lock_id);
+    }
+    // [coherence_initialize] registers a bootstrap instance and queues the message that creates
+    // [Main] on it. Running it here means [Main] exists once [coh_runtime_init] returns.
+    coherence_initialize();
+    runtime_ds->main_instance_id = runtime_ds->instances_created + 1;
+    uint64_t bootstrap_instance_id = runtime_ds->pop_runnable();
+    run_instance(bootstrap_instance_id);
+    assert(runtime_ds->instances_created >= runtime_ds->main_instance_id);
+}
+
+void coh_runtime_start(void) {
+#ifndef COH_SINGLE_THREADED
+    workers.reserve(runtime_ds->num_workers);
+    for (uint32_t i = 0; i < runtime_ds->num_workers; ++i) {
+        workers.emplace_back(&thread_loop);
+    }
+#endif
+}
+
+uint64_t coh_runtime_main_actor(void) {
+    return runtime_ds->main_instance_id;
+}
+
+int64_t coh_runtime_behaviour_index(uint64_t instance_id, void (*behaviour_fn)(void*, void*)) {
+    auto actor_instance_opt = runtime_ds->id_actor_instance_map.get_value(instance_id);
+    assert(actor_instance_opt != std::nullopt);
+    const ActorDescriptor* descriptor = (*actor_instance_opt)->descriptor;
+    for(uint64_t behaviour_index = 0; behaviour_index < descriptor->num_behaviours; behaviour_index++) {
+        if(descriptor->behaviour_fns[behaviour_index] == behaviour_fn) {
+            return static_cast<int64_t>(behaviour_index);
+        }
+    }
+    return -1;
+}
+
+void coh_runtime_send_indexed(uint64_t instance_id, void* message, int64_t behaviour_index) {
+    auto actor_instance_opt = runtime_ds->id_actor_instance_map.get_value(instance_id);
+    assert(actor_instance_opt != std::nullopt);
+    // The dispatch function of the receiver has no case for any other index
+    if(behaviour_index < 0 || 
+        static_cast<uint64_t>(behaviour_index) >= (*actor_instance_opt)->descriptor->num_behaviours) {
+        std::cerr << "coh_runtime_send: actor " << instance_id << " has no behaviour " << behaviour_index 
+        << std::endl;
+        std::abort();
+    }
+    deliver_external_message(*actor_instance_opt, instance_id, message, static_cast<uint32_t>(behaviour_index));
+}
+
+void coh_runtime_send(uint64_t instance_id, void* message, void (*behaviour_fn)(void*, void*)) {
+    // Messages carry the index of the behaviour in the receiver's descriptor
+    coh_runtime_send_indexed(instance_id, message, coh_runtime_behaviour_index(instance_id, behaviour_fn));
+}
+
+void coh_runtime_retain_actor(uint64_t instance_id) {
+    actor_retain(instance_id);
+}
+
+void coh_runtime_release_actor(uint64_t instance_id) {
+    actor_release(instance_id);
+}
+
+void coh_runtime_wait_quiescent(void) {
+#ifdef COH_SINGLE_THREADED
+    thread_loop();
+#else
+    {
+        std::unique_lock<RuntimeMutex> lock_guard(runtime_ds->schedule_queue_lock);
+        runtime_ds->quiescence_bed.wait(lock_guard, [] {
+            return !runtime_ds->has_runnable() && 
+                runtime_ds->threads_asleep == runtime_ds->num_workers &&
+                runtime_ds->pending_timers == 0;
+        });
+    }
+#endif
+    flush_output();
+}
+
+void coh_runtime_stop(void) {
+    coh_runtime_wait_quiescent();
+#ifndef COH_SINGLE_THREADED
+    {
+        std::lock_guard<RuntimeMutex> lock_guard(runtime_ds->schedule_queue_lock);
+        runtime_ds->stopping = true;
+        runtime_ds->thread_bed.notify_all();
+    }
+    for (auto &t : workers) {
+        t.join();
+    }
+    workers.clear();
+#endif
+}
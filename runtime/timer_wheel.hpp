@@ -0,0 +1,126 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/*
+Hierarchical timer wheel with a resolution of one tick (1ms in the runtime). Level [l] has
+[SLOTS] slots, each spanning SLOTS^l ticks. A timer is placed on the lowest level whose span
+covers its distance from the current tick, and is cascaded down a level whenever the wheel
+reaches the start of its slot. Timers further away than the top level can represent wait in
+[overflow] and are cascaded from there.
+Insertion is O(1), and advancing is O(1) per tick plus the cost of cascading.
+[T] is the payload delivered when a timer expires.
+*/
+template <typename T>
+class TimerWheel {
+private:
+    static constexpr uint64_t SLOT_BITS = 6;
+    static constexpr uint64_t SLOTS = 1 << SLOT_BITS;
+    static constexpr uint64_t LEVELS = 4;
+
+    struct Timer {
+        uint64_t deadline;
+        T payload;
+    };
+
+    uint64_t current_tick = 0;
+    uint64_t num_timers = 0;
+    std::array<std::array<std::vector<Timer>, SLOTS>, LEVELS> wheels;
+    std::vector<Timer> overflow;
+
+    static uint64_t slot_of(uint64_t tick, uint64_t level) {
+        return (tick >> (level * SLOT_BITS)) & (SLOTS - 1);
+    }
+
+    void place(Timer timer) {
+        uint64_t delta = timer.deadline - current_tick;
+        for(uint64_t level = 0; level < LEVELS; level++) {
+            if(delta < (uint64_t(1) << ((level + 1) * SLOT_BITS))) {
+                wheels[level][slot_of(timer.deadline, level)].emplace_back(std::move(timer));
+                return;
+            }
+        }
+        overflow.emplace_back(std::move(timer));
+    }
+
+    // Moves the timers of the slot starting at [current_tick] on [level] to the lower levels
+    void cascade(uint64_t level) {
+        std::vector<Timer> timers;
+        if(level == LEVELS) {
+            timers.swap(overflow);
+        }
+        else {
+            timers.swap(wheels[level][slot_of(current_tick, level)]);
+        }
+        for(Timer& timer: timers) {
+            place(std::move(timer));
+        }
+    }
+
+public:
+    bool empty() const {
+        return num_timers == 0;
+    }
+
+    uint64_t size() const {
+        return num_timers;
+    }
+
+    // Registers [payload] to expire at [deadline]. Deadlines that already passed expire on the
+    // next tick. [now] is the current time; the wheel is only advanced while it holds timers, so
+    // an empty wheel jumps to [now] instead of later stepping through every idle tick.
+    void insert(uint64_t now, uint64_t deadline, T payload) {
+        if(num_timers == 0) {
+            current_tick = std::max(current_tick, now);
+        }
+        if(deadline <= current_tick) {
+            deadline = current_tick + 1;
+        }
+        num_timers++;
+        place(Timer{deadline, std::move(payload)});
+    }
+
+    // Advances the wheel to [now], appending the payloads of all expired timers to [expired]
+    void advance(uint64_t now, std::vector<T>& expired) {
+        if(num_timers == 0) {
+            current_tick = std::max(current_tick, now);
+            return;
+        }
+        while(current_tick < now) {
+            current_tick++;
+            for(uint64_t level = 1; level <= LEVELS; level++) {
+                if(slot_of(current_tick, level - 1) != 0) {
+                    break;
+                }
+                cascade(level);
+            }
+            std::vector<Timer>& slot = wheels[0][slot_of(current_tick, 0)];
+            for(Timer& timer: slot) {
+                expired.emplace_back(std::move(timer.payload));
+            }
+            num_timers -= slot.size();
+            slot.clear();
+            if(num_timers == 0) {
+                current_tick = now;
+            }
+        }
+    }
+
+    // A tick by which the wheel must be advanced again. It is never later than the earliest
+    // deadline, but can be earlier when the next timer still has to be cascaded.
+    std::optional<uint64_t> next_wakeup() const {
+        if(num_timers == 0) {
+            return std::nullopt;
+        }
+        for(uint64_t tick = current_tick + 1; slot_of(tick, 0) != 0; tick++) {
+            if(!wheels[0][slot_of(tick, 0)].empty()) {
+                return tick;
+            }
+        }
+        // Nothing left on the lowest level before the next cascade
+        return (current_tick | (SLOTS - 1)) + 1;
+    }
+};
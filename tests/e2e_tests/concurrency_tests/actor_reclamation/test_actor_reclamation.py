@@ -0,0 +1,14 @@
+import pathlib
+from e2e_tests.test_utilities import *
+
+TESTS_ROOT = pathlib.Path(__file__).resolve().parents[0]
+
+def test_actor_reclamation(tmp_path):
+    prog_path = TESTS_ROOT / "prog.coh"
+    output = compile_and_run(prog_path, tmp_path)
+    assert output == [30000], f"expected every worker to report once, got {output}"
+
+def test_actor_reclamation_single_threaded(tmp_path):
+    prog_path = TESTS_ROOT / "prog.coh"
+    output = compile_and_run(prog_path, tmp_path, ["--single-threaded", "true"])
+    assert output == [30000], f"expected every worker to report once, got {output}"
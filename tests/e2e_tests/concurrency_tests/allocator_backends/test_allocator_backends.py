@@ -0,0 +1,13 @@
+import pathlib
+import pytest
+from e2e_tests.test_utilities import *
+
+TESTS_ROOT = pathlib.Path(__file__).resolve().parents[0]
+
+@pytest.mark.parametrize("single_threaded", ["false", "true"])
+@pytest.mark.parametrize("allocator", ["actor-heap", "libc", "size-class", "bump"])
+def test_allocator_backends(tmp_path, allocator, single_threaded):
+    prog_path = TESTS_ROOT / "prog.coh"
+    output = compile_and_run(prog_path, tmp_path, 
+        ["--allocator", allocator, "--single-threaded", single_threaded])
+    assert output == [17000], f"wrong total with the {allocator} allocator"
@@ -0,0 +1,24 @@
+import pathlib
+import time
+from e2e_tests.test_utilities import *
+
+TESTS_ROOT = pathlib.Path(__file__).resolve().parents[0]
+
+def check_output(output: list[int]):
+    assert output[:2] == [0, 1] or output[:2] == [1, 0], f"undelayed sends must come first, got {output}"
+    assert output.index(2) < output.index(3), f"delayed sends out of deadline order, got {output}"
+    assert 100 in output, "ticker did not finish"
+    assert len(output) == 5
+
+def test_delayed_send(tmp_path):
+    prog_path = TESTS_ROOT / "prog.coh"
+    start = time.perf_counter()
+    output = compile_and_run(prog_path, tmp_path)
+    # The ticker alone needs 100 * 2ms
+    assert time.perf_counter() - start >= 0.2
+    check_output(output)
+
+def test_delayed_send_single_threaded(tmp_path):
+    prog_path = TESTS_ROOT / "prog.coh"
+    output = compile_and_run(prog_path, tmp_path, ["--single-threaded", "true"])
+    check_output(output)
@@ -0,0 +1,62 @@
+#include "coherence_runtime.h"
+// Written by the compiler next to out.o
+#include "out.h"
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+// Not a behaviour of [Main]
+extern "C" void not_a_behaviour(void*, void*) {}
+
+// Resolved once in [main]
+static int64_t add_index = -1;
+
+void send_add(uint64_t actor, bool twice, int32_t amount) {
+    auto* message = static_cast<add_Main_be_struct*>(coh_alloc(sizeof(add_Main_be_struct)));
+    message->twice = twice;
+    message->amount = amount;
+    message->this_id = actor;
+    coh_runtime_send_indexed(actor, message, add_index);
+}
+
+void send_report(uint64_t actor) {
+    auto* message = static_cast<report_Main_be_struct*>(coh_alloc(sizeof(report_Main_be_struct)));
+    message->this_id = actor;
+    coh_runtime_send(actor, message, report_Main_be);
+}
+
+int main(int argc, char* argv[]) {
+    CohRuntimeConfig config{};
+    config.num_workers = 4;
+    coh_runtime_init(&config);
+    coh_runtime_start();
+    uint64_t main_actor = coh_runtime_main_actor();
+    if(coh_runtime_behaviour_index(main_actor, not_a_behaviour) != -1) {
+        return 1;
+    }
+    if(argc > 1) {
+        // Aborts
+        coh_runtime_send(main_actor, coh_alloc(sizeof(report_Main_be_struct)), not_a_behaviour);
+    }
+    add_index = coh_runtime_behaviour_index(main_actor, add_Main_be);
+
+    std::vector<std::thread> host_threads;
+    for(int t = 0; t < 4; t++) {
+        host_threads.emplace_back([main_actor] {
+            for(int i = 0; i < 10000; i++) {
+                send_add(main_actor, false, 1);
+            }
+        });
+    }
+    for(auto& t: host_threads) {
+        t.join();
+    }
+    coh_runtime_wait_quiescent();
+    send_report(main_actor);
+
+    // The runtime keeps running between quiescent points
+    send_add(main_actor, true, 5);
+    send_report(main_actor);
+    coh_runtime_stop();
+    return 0;
+}
@@ -0,0 +1,25 @@
+import os
+import pathlib
+from e2e_tests.test_utilities import *
+
+TESTS_ROOT = pathlib.Path(__file__).resolve().parents[0]
+
+def test_embedding_host(tmp_path):
+    compiler = os.environ.get("COH_COMPILER")
+    embed_lib = os.environ.get("COH_EMBED_LIB")
+    include_dir = os.environ.get("COH_RUNTIME_INCLUDE_DIR")
+    assert embed_lib and include_dir, "COH_EMBED_LIB/COH_RUNTIME_INCLUDE_DIR not set"
+    r = run([compiler, "--input-file", str(TESTS_ROOT / "prog.coh"), "--output-dir", str(tmp_path),
+             "--emit-object", "true"])
+    assert r.returncode == 0, "Compilation failed"
+    exe = tmp_path / "host"
+    r = run(["clang++", "-std=c++20", "-I", include_dir, "-I", str(tmp_path), str(TESTS_ROOT / "host.cpp"),
+             str(tmp_path / "out.o"), embed_lib, "-lboost_context", "-pthread", "-o", str(exe)])
+    assert r.returncode == 0, f"Linking the host failed: {r.stderr}"
+    rr = run([str(exe)])
+    assert rr.returncode == 0, "A function that is not a behaviour was given an index"
+    assert to_list(rr.stdout) == [40000, 40010]
+    # Sending to a function that is not a behaviour is rejected instead of dispatched
+    rr = run([str(exe), "unknown-behaviour"])
+    assert rr.returncode != 0
+    assert "has no behaviour" in rr.stderr
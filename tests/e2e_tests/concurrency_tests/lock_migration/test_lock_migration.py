@@ -0,0 +1,23 @@
+import os
+import pathlib
+import pytest
+from e2e_tests.test_utilities import *
+
+TESTS_ROOT = pathlib.Path(__file__).resolve().parents[0]
+
+def check_output(output: list[int]):
+    output.sort()
+    assert output[:-1] == list(range(2000)), "output is not a permutation of 0, 1 ... 1999"
+    assert output[-1] == 1999000, "a message sent after resuming was lost"
+
+def test_lock_migration(tmp_path):
+    prog_path = TESTS_ROOT / "prog.coh"
+    check_output(compile_and_run(prog_path, tmp_path))
+
+# With the runtime inlined into the behaviours, accesses to its thread_locals must not outlive a
+# suspend
+@pytest.mark.skipif(os.environ.get("COH_LTO_AVAILABLE") != "1",
+    reason="the compiler was built without the runtime bitcode")
+def test_lock_migration_lto(tmp_path):
+    prog_path = TESTS_ROOT / "prog.coh"
+    check_output(compile_and_run(prog_path, tmp_path, ["--optimize", "true", "--lto", "true"]))
@@ -8,3 +8,10 @@ def test_ring_token(tmp_path):
     output = compile_and_run(prog_path, tmp_path)
     for i in range(10000):
         assert output[i] == 10000 - i, f"expected {i}th position to be {10000 - i}, got {output[i]}"
+
+
+def test_ring_token_unbuffered_output(tmp_path):
+    prog_path = TESTS_ROOT / "prog.coh"
+    output = compile_and_run(prog_path, tmp_path, ["--unbuffered-output", "true"])
+    for i in range(10000):
+        assert output[i] == 10000 - i, f"expected {i}th position to be {10000 - i}, got {output[i]}"
@@ -0,0 +1,9 @@
+import pathlib
+from e2e_tests.test_utilities import *
+
+TESTS_ROOT = pathlib.Path(__file__).resolve().parents[0]
+
+def test_single_threaded_runtime(tmp_path):
+    prog_path = TESTS_ROOT / "prog.coh"
+    output = compile_and_run(prog_path, tmp_path, ["--single-threaded", "true"])
+    assert output == list(range(1000)), "single-threaded schedule must be FIFO"
@@ -0,0 +1,15 @@
+import os
+import pathlib
+import subprocess
+from e2e_tests.test_utilities import *
+
+TESTS_ROOT = pathlib.Path(__file__).resolve().parents[0]
+
+def test_unlock_delivery(tmp_path):
+    compiler = os.environ.get("COH_COMPILER")
+    assert compiler, "COH_COMPILER env var not set to coherencec path"
+    r = run([compiler, "--input-file", str(TESTS_ROOT / "prog.coh"), "--output-dir", str(tmp_path)])
+    assert r.returncode == 0, "Compilation failed"
+    # Without the delivery on unlock, the setter only gets the message after the probe
+    rr = subprocess.run([str(tmp_path / "out")], text=True, capture_output=True, timeout=60)
+    assert to_list(rr.stdout) == [42]
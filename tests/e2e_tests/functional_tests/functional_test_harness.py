@@ -39,4 +39,82 @@ def test_functional(test_dir, tmp_path):
 
     rr = run([str(exe)])
     prog_out = to_list(rr.stdout)
-    assert data["output"] == prog_out, "Outputs do not match"
\ No newline at end of file
+    assert data["output"] == prog_out, "Outputs do not match"
+
+# Same programs, optimized. The optimizer skips the loop passes LLVM 14 crashes on (see
+# [optimize_module]), and these make sure it still runs on every program.
+@pytest.mark.parametrize("test_dir", TEST_DIRS, ids=[d.name for d in TEST_DIRS])
+def test_functional_optimized(test_dir, tmp_path):
+    coh = test_dir / "prog.coh"
+    with open(test_dir / 'test_info.json', 'r') as file:
+        data = json.load(file)
+
+    compiler = os.environ.get("COH_COMPILER")
+    assert compiler, "COH_COMPILER env var not set to coherencec path"
+
+    r = run([compiler, "--input-file", str(coh), "--output-dir", str(tmp_path), "--optimize", "true"])
+
+    if data["compiles"]:
+        assert r.returncode == 0, "Expected to compile, but did not"
+    else:
+        assert r.returncode != 0, "Expected not to compile, but did"
+        return
+
+    rr = run([str(tmp_path / "out")])
+    assert data["output"] == to_list(rr.stdout), "Outputs do not match"
+
+# The loop that needs runtime alias checks is left alone, the other one is still vectorized
+def test_loop_vectorization(tmp_path):
+    compiler = os.environ.get("COH_COMPILER")
+    assert compiler, "COH_COMPILER env var not set to coherencec path"
+
+    coh = TESTS_ROOT / "loop_vectorization" / "prog.coh"
+    r = run([compiler, "--input-file", str(coh), "--output-dir", str(tmp_path), 
+        "--optimize", "true", "--emit-llvm", "true", "--jobs", "1"])
+    assert r.returncode == 0, "Expected to compile, but did not"
+
+    vectorized = set()
+    function = None
+    for line in (tmp_path / "out_opt.ll").read_text().splitlines():
+        if line.startswith("define "):
+            function = line.split("@")[1].split("(")[0]
+        elif line.startswith("vector.body"):
+            vectorized.add(function)
+    assert "scale.Buffers.be" in vectorized
+    assert "mix.Buffers.be" not in vectorized
+
+# Same programs, run in the JIT instead of as an executable. Split into several modules even on
+# machines with few cores, so that references across partitions are covered.
+@pytest.mark.parametrize("test_dir", TEST_DIRS, ids=[d.name for d in TEST_DIRS])
+def test_functional_jit(test_dir):
+    coh = test_dir / "prog.coh"
+    with open(test_dir / 'test_info.json', 'r') as file:
+        data = json.load(file)
+
+    compiler = os.environ.get("COH_COMPILER")
+    assert compiler, "COH_COMPILER env var not set to coherencec path"
+
+    r = run([compiler, "--input-file", str(coh), "--run", "true", "--jobs", "4"])
+
+    if data["compiles"]:
+        assert r.returncode == 0, "Expected to run, but did not"
+    else:
+        assert r.returncode != 0, "Expected not to compile, but did"
+        return
+
+    assert data["output"] == to_list(r.stdout), "Outputs do not match"
+
+# The layouts chosen for a program with an actor larger than a cache line
+def test_layout_report(tmp_path):
+    compiler = os.environ.get("COH_COMPILER")
+    assert compiler, "COH_COMPILER env var not set to coherencec path"
+
+    coh = TESTS_ROOT / "struct_layout_cache_lines" / "prog.coh"
+    r = run([compiler, "--input-file", str(coh), "--output-dir", str(tmp_path), "--layout-report", "true"])
+    assert r.returncode == 0, "Expected to compile, but did not"
+
+    report = (tmp_path / "layout_report.txt").read_text().splitlines()
+    # [sample] touches one cache line instead of two
+    assert "Sensor.struct: 72 -> 72 bytes (count i32, last i32, readings %window.struct)" in report
+    # The messages of [Main] are no exception
+    assert "collect.Main.be.struct: 16 -> 16 bytes (value i32, valid i1, this.id i64)" in report